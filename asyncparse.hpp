@@ -0,0 +1,112 @@
+#pragma once
+
+#include "incremental.hpp"
+#include <string_view>
+#include <coroutine>
+#include <utility>
+#include <concepts>
+#include <exception>
+
+// a parse awaited from a C++20 coroutine. it starts when first awaited (or
+// start()ed) and is done once its parser has reached a result; the result
+// lives in the AsyncParser that made the task, not in the task.
+template<typename T>
+struct ParseTask {
+    struct promise_type {
+        ParseResult<T> *result = nullptr;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+        ParseTask get_return_object() {
+            return ParseTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+        // hands control straight to whoever awaited the task
+        auto final_suspend() noexcept {
+            struct Final {
+                bool await_ready() noexcept {
+                    return false;
+                }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    return h.promise().continuation;
+                }
+                void await_resume() noexcept {}
+            };
+            return Final{};
+        }
+        void return_value(ParseResult<T> &r) {
+            result = &r;
+        }
+        void unhandled_exception() {
+            error = std::current_exception();
+        }
+    };
+    ParseTask(ParseTask &&t) noexcept : h(std::exchange(t.h, nullptr)) {}
+    ParseTask &operator=(ParseTask &&t) noexcept {
+        std::swap(h, t.h);
+        return *this;
+    }
+    ~ParseTask() {
+        if (h) h.destroy();
+    }
+    bool await_ready() const {
+        return h.done();
+    }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) {
+        h.promise().continuation = c;
+        return h;
+    }
+    ParseResult<T> &await_resume() {
+        return result();
+    }
+    // runs the task until its first read suspends it, for callers that are
+    // not coroutines themselves; the reads' resumptions drive it from there
+    void start() {
+        if (!h.done()) h.resume();
+    }
+    bool done() const {
+        return h.done();
+    }
+    ParseResult<T> &result() {
+        if (h.promise().error) std::rethrow_exception(h.promise().error);
+        return *h.promise().result;
+    }
+private:
+    explicit ParseTask(std::coroutine_handle<promise_type> h) : h(h) {}
+    std::coroutine_handle<promise_type> h;
+};
+
+// an IncrementalParser that pulls its input from a coroutine source, such
+// as a socket on an event loop:
+//     ParseResult<JsonValue> &r = co_await parser.feed([&] { return socket.read(); });
+// read() returns anything co_await can take that yields a std::string_view
+// chunk, an empty one at the end of the input. the chunk is copied before
+// the next read, so the reactor may reuse its buffer. between chunks the
+// parse waits on its own stack, not on a thread, so one thread can drive
+// any number of them.
+//
+// what each parse holds is what is reserved for IncrementalParser: its
+// input region and its stack, of which only the pages touched take memory.
+// pass a smaller capacity and stackSize when there are very many parses,
+// and use discardCommitted() on long streams of records.
+//
+// the task must be resumed on the thread that created the parser, which is
+// how a single-threaded reactor runs it anyway.
+template<typename T>
+struct AsyncParser : IncrementalParser<T> {
+    using IncrementalParser<T>::IncrementalParser;
+    using IncrementalParser<T>::feed;
+    template<typename Read>
+        requires std::invocable<Read &>
+    ParseTask<T> feed(Read read) {
+        // a parse that is done reads nothing more, so that what follows it
+        // is left for the next reader of the source
+        while (!this->done()) {
+            std::string_view chunk = co_await read();
+            if (chunk.empty()) this->finish();
+            else IncrementalParser<T>::feed(chunk);
+        }
+        co_return this->finish();
+    }
+};
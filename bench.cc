@@ -0,0 +1,393 @@
+// benchmarks of the JSON front ends and of single combinators. build with
+// optimizations and run:
+//     g++ -std=c++17 -O2 -pthread -o bench bench.cc
+//     ./bench [--json] [--baseline=old.json] [--min-time=0.5] [--filter=text] [file.json|file.ndjson ...]
+// the corpora are generated, in the shapes of twitter.json, canada.json and
+// citm_catalog.json; the real files, or any others, are benchmarked too
+// when passed by path. --json writes the results as a JSON array, which
+// --baseline reads back to print the change in speed of every case.
+#include "cparsec.hpp"
+#include "jsonp.hpp"
+#include "jsontape.hpp"
+#include "jsonsax.hpp"
+#include "jsontokens.hpp"
+#include "jsonwriter.hpp"
+#include "records.hpp"
+#include "parsefile.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <memory_resource>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <sys/resource.h>
+
+// every allocation of the process passes through here to be counted. gcc
+// cannot see that these new and delete are a pair, and warns at the calls.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+std::atomic<unsigned long long> allocations{0};
+
+void *operator new(size_t n) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void *operator new(size_t n, std::align_val_t a) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(a);
+    if (void *p = std::aligned_alloc(align, (n + align - 1) / align * align)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+// the high-water mark of resident memory in kB. the mark is reset before
+// each case where the kernel allows it, otherwise it is the process's peak.
+long peakRss() {
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while (std::getline(in, line))
+        if (line.rfind("VmHWM:", 0) == 0) return std::atol(line.c_str() + 6);
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+void resetPeakRss() {
+    std::ofstream out("/proc/self/clear_refs");
+    out << "5";
+}
+
+struct Rng {
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    uint64_t next() {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    }
+    size_t below(size_t n) {
+        return next() % n;
+    }
+    std::string word(size_t n) {
+        std::string w;
+        for (size_t i = 0; i < n; i++) w += 'a' + below(26);
+        return w;
+    }
+};
+
+std::string num(double x) {
+    char b[32];
+    return std::string(b, std::to_chars(b, b + sizeof(b), x).ptr);
+}
+
+// many mid-sized objects of strings, escapes and non-ASCII text included,
+// with a nested user object each
+std::string twitterLike(size_t n) {
+    Rng r;
+    std::string s = "{\"statuses\": [";
+    for (size_t i = 0; i < n; i++) {
+        if (i) s += ",";
+        s += "{\"id\": " + std::to_string(r.next() >> 12) + ", \"text\": \"" + r.word(40) + " \\u3042\\u3044 \\\"" + r.word(8) +
+             "\\\" \xe6\x97\xa5\xe6\x9c\xac\", \"truncated\": false, \"in_reply_to\": null, \"entities\": {\"hashtags\": [],"
+             " \"urls\": [{\"url\": \"https:\\/\\/t.co\\/" + r.word(10) + "\", \"indices\": [" + std::to_string(r.below(100)) + ", " +
+             std::to_string(r.below(140)) + "]}]}, \"user\": {\"id\": " + std::to_string(r.next() >> 20) + ", \"name\": \"" +
+             r.word(12) + "\", \"screen_name\": \"" + r.word(10) + "\", \"followers_count\": " + std::to_string(r.below(100000)) +
+             ", \"verified\": " + (r.below(2) ? "true" : "false") + ", \"description\": \"" + r.word(60) + "\"}, \"retweet_count\": " +
+             std::to_string(r.below(1000)) + ", \"lang\": \"ja\"}";
+    }
+    return s + "]}";
+}
+
+// a few polygons of very many coordinate pairs: almost all numbers
+std::string canadaLike(size_t n) {
+    Rng r;
+    std::string s = "{\"type\": \"FeatureCollection\", \"features\": [{\"type\": \"Feature\", \"properties\": {\"name\": \"Canada\"},"
+                    " \"geometry\": {\"type\": \"Polygon\", \"coordinates\": [";
+    for (size_t ring = 0; ring < 16; ring++) {
+        if (ring) s += ",";
+        s += "[";
+        for (size_t i = 0; i < n / 16; i++) {
+            if (i) s += ",";
+            s += "[" + num(-141.0 + r.below(1 << 30) / double(1 << 24)) + "," + num(41.0 + r.below(1 << 30) / double(1 << 25)) + "]";
+        }
+        s += "]";
+    }
+    return s + "]}}]}";
+}
+
+// objects keyed by id, full of small integers, short arrays and nulls
+std::string citmLike(size_t n) {
+    Rng r;
+    std::string s = "{\"areaNames\": {";
+    for (size_t i = 0; i < n / 8; i++) s += (i ? ", \"" : "\"") + std::to_string(205705993 + i) + "\": \"" + r.word(20) + "\"";
+    s += "}, \"performances\": [";
+    for (size_t i = 0; i < n; i++) {
+        if (i) s += ", ";
+        s += "{\"eventId\": " + std::to_string(138586341 + r.below(1000)) + ", \"id\": " + std::to_string(339887544 + i) +
+             ", \"logo\": null, \"name\": null, \"prices\": [{\"amount\": " + std::to_string(r.below(100000)) +
+             ", \"audienceSubCategoryId\": 337100890, \"seatCategoryId\": 338937295}, {\"amount\": " + std::to_string(r.below(100000)) +
+             ", \"audienceSubCategoryId\": 337100890, \"seatCategoryId\": 338937296}], \"seatCategories\": [{\"areas\": [{\"areaId\": " +
+             std::to_string(205705999 + r.below(50)) + ", \"blockIds\": []}], \"seatCategoryId\": 338937295}], \"seatMapImage\": null,"
+             " \"start\": " + std::to_string(1372701600000ULL + r.below(1000000)) + ", \"venueCode\": \"PLEYEL_PLEYEL\"}";
+    }
+    return s + "]}";
+}
+
+// many documents nested depth deep, alternating arrays and objects
+std::string deepNesting(size_t docs, size_t depth) {
+    std::string one;
+    for (size_t i = 0; i < depth; i++) one += i % 2 ? "{\"k\": " : "[";
+    one += "1";
+    for (size_t i = depth; i--; ) one += i % 2 ? "}" : "]";
+    std::string s = "[";
+    for (size_t i = 0; i < docs; i++) s += (i ? "," : "") + one;
+    return s + "]";
+}
+
+// a few very long strings with a rare escape
+std::string longStrings(size_t n, size_t size) {
+    Rng r;
+    std::string s = "[";
+    for (size_t i = 0; i < n; i++) {
+        s += i ? ", \"" : "\"";
+        for (size_t j = 0; j < size; j += 64) s += r.word(63) + (r.below(8) ? " " : "\\n");
+        s += "\"";
+    }
+    return s + "]";
+}
+
+std::string ndjson(size_t n) {
+    Rng r;
+    std::string s;
+    for (size_t i = 0; i < n; i++)
+        s += "{\"ts\": " + std::to_string(1600000000 + i) + ", \"level\": \"" + (r.below(4) ? "info" : "warn") + "\", \"msg\": \"" +
+             r.word(30) + "\", \"tags\": [\"" + r.word(5) + "\", \"" + r.word(6) + "\"], \"ok\": " + (r.below(2) ? "true" : "false") + "}\n";
+    return s;
+}
+
+struct Options {
+    bool json = false;
+    double minTime = 0.5;
+    std::string filter, baseline;
+    bool wanted(const std::string &name) const {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+};
+
+struct Result {
+    std::string name, parser;
+    size_t bytes;
+    double mbps, allocs;
+    long peakKb;
+    bool ok;
+};
+
+// runs run() over docs documents of bytes in total until minTime has
+// passed. allocations are those of one run per document.
+Result measure(const Options &o, std::string name, std::string parser, size_t bytes, size_t docs, const std::function<bool()> &run) {
+    resetPeakRss();
+    unsigned long long a = allocations.load();
+    bool ok = run();
+    double allocs = double(allocations.load() - a) / docs;
+    size_t iters = 0;
+    double elapsed = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (ok && (elapsed < o.minTime || iters < 2)) {
+        ok = run();
+        iters++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return Result{name, parser, bytes, ok ? bytes * iters / elapsed / 1e6 : 0, allocs, peakRss(), ok};
+}
+
+template<typename T>
+bool whole(const Parser<T> &p, std::string_view s, ParseContext ctx = ParseContext()) {
+    return parse(leftP(p, eofP), s, ctx).success;
+}
+
+// a JSON document through every front end
+void document(const Options &o, std::vector<Result> &out, const std::string &name, const std::string &s) {
+    Parser<JsonValue> treeP = jsonP(), stackP = jsonStackP();
+    out.push_back(measure(o, name, "jsonP", s.size(), 1, [&] { return whole(treeP, s); }));
+    std::pmr::monotonic_buffer_resource arena;
+    out.push_back(measure(o, name, "jsonP/arena", s.size(), 1, [&] {
+        ParseContext ctx;
+        ctx.memory = &arena;
+        bool ok = whole(treeP, s, ctx);
+        arena.release();
+        return ok;
+    }));
+    out.push_back(measure(o, name, "jsonStackP", s.size(), 1, [&] { return whole(stackP, s); }));
+    out.push_back(measure(o, name, "tokens", s.size(), 1, [&] { return parseJsonTokens(s).success; }));
+    JsonHandler events;
+    out.push_back(measure(o, name, "sax", s.size(), 1, [&] { return parseSax(s, events).success; }));
+    JsonTape tape;
+    out.push_back(measure(o, name, "tape", s.size(), 1, [&] { return tape.parse(s); }));
+}
+
+void records(const Options &o, std::vector<Result> &out, const std::string &name, const std::string &s) {
+    size_t docs = std::count(s.begin(), s.end(), '\n');
+    WorkPool one(1);
+    Parser<JsonValue> treeP = jsonP();
+    out.push_back(measure(o, name, "parseRecords", s.size(), docs ? docs : 1, [&] {
+        Records<JsonValue> rs = parseRecords(treeP, s, one);
+        for (const ParseResult<JsonValue> &r : rs.results)
+            if (!r.success) return false;
+        return true;
+    }));
+}
+
+template<typename T>
+void micro(const Options &o, std::vector<Result> &out, const std::string &name, const Parser<T> &p, const std::string &s) {
+    if (o.wanted(name)) out.push_back(measure(o, name, "micro", s.size(), 1, [&] { return whole(p, s); }));
+}
+
+void microbenchmarks(const Options &o, std::vector<Result> &out) {
+    Rng r;
+    size_t n = 1 << 20;
+    micro(o, out, "manyP(charP)", manyP(charP('a')), std::string(n, 'a'));
+    std::string hellos;
+    while (hellos.size() < n) hellos += "hello";
+    micro(o, out, "stringP", manyP(stringP("hello")), hellos);
+    std::string numbers;
+    while (numbers.size() < n) numbers += num((long long) (r.next() >> 20) / 1e6 - 1e6) + " ";
+    micro(o, out, "doubleP", manyP(trimP(doubleP)), numbers);
+    std::string strings;
+    while (strings.size() < n) strings += "\"" + r.word(12) + "\\n\\u00e9" + r.word(8) + "\" ";
+    micro(o, out, "escapeStrP", manyP(escapeStrP), strings);
+    // alternatives told apart by their first byte, and alternatives that
+    // all start alike and are tried in turn
+    std::string letters, keys;
+    while (letters.size() < n) letters += 'a' + r.below(8);
+    while (keys.size() < n) keys += "k" + std::to_string(r.below(8));
+    micro(o, out, "orP/dispatch", manyP(orP(charP('a'), charP('b'), charP('c'), charP('d'), charP('e'), charP('f'), charP('g'), charP('h'))), letters);
+    micro(o, out, "orP/backtrack", manyP(orP(literalP("k0"), literalP("k1"), literalP("k2"), literalP("k3"), literalP("k4"),
+                                              literalP("k5"), literalP("k6"), literalP("k7"))), keys);
+}
+
+// the MB/s of each case of a previous --json run, by name and parser
+std::map<std::string, double> readBaseline(const std::string &path) {
+    std::map<std::string, double> speeds;
+    MappedFile f(path);
+    ParseResult<JsonValue> r = parse(leftP(jsonP(), eofP), f.view());
+    if (f.error || !r.success || r.result.type != JsonValue::JSON_ARRAY) {
+        std::cerr << "bench: cannot read baseline " << path << "\n";
+        return speeds;
+    }
+    for (const JsonValue &c : r.result.arrayValue) {
+        const JsonValue *name = c.find("name"), *parser = c.find("parser"), *mbps = c.find("mbps");
+        if (name && parser && mbps)
+            speeds[std::string(name->strValue) + "/" + std::string(parser->strValue)] = mbps->numValue;
+    }
+    return speeds;
+}
+
+void report(const Options &o, const std::vector<Result> &results) {
+    if (o.json) {
+        JsonWriter w(2);
+        w.onStartArray();
+        for (const Result &r : results) {
+            w.onStartObject();
+            w.onKey("name");
+            w.onString(r.name);
+            w.onKey("parser");
+            w.onString(r.parser);
+            w.onKey("bytes");
+            w.onNumber(r.bytes);
+            w.onKey("mbps");
+            w.onNumber(r.mbps);
+            w.onKey("allocs");
+            w.onNumber(r.allocs);
+            w.onKey("peakKb");
+            w.onNumber(r.peakKb);
+            w.onKey("ok");
+            w.onBool(r.ok);
+            w.onEndObject();
+        }
+        w.onEndArray();
+        std::cout << w.view() << "\n";
+        return;
+    }
+    std::map<std::string, double> base;
+    if (!o.baseline.empty()) base = readBaseline(o.baseline);
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-16s %-14s %10s %10s %14s %10s%s\n", "case", "parser", "MB", "MB/s", "allocs/doc", "peak MB",
+                  base.empty() ? "" : "     change");
+    std::cout << line;
+    for (const Result &r : results) {
+        std::snprintf(line, sizeof(line), "%-16s %-14s %10.2f %10.1f %14.1f %10.1f", r.name.c_str(), r.parser.c_str(), r.bytes / 1e6,
+                      r.mbps, r.allocs, r.peakKb / 1024.0);
+        std::cout << line;
+        auto b = base.find(r.name + "/" + r.parser);
+        if (!r.ok) std::cout << "     FAILED";
+        else if (b != base.end() && b->second > 0) {
+            std::snprintf(line, sizeof(line), " %+9.1f%%", (r.mbps / b->second - 1) * 100);
+            std::cout << line;
+        }
+        std::cout << "\n";
+    }
+}
+
+int main(int argc, char **argv) {
+    Options o;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "--json") o.json = true;
+        else if (a.rfind("--baseline=", 0) == 0) o.baseline = a.substr(11);
+        else if (a.rfind("--min-time=", 0) == 0) o.minTime = std::atof(a.c_str() + 11);
+        else if (a.rfind("--filter=", 0) == 0) o.filter = a.substr(9);
+        else if (a.rfind("--", 0) == 0) {
+            std::cerr << "usage: bench [--json] [--baseline=file] [--min-time=seconds] [--filter=text] [file ...]\n";
+            return 2;
+        } else files.push_back(a);
+    }
+    std::vector<Result> results;
+    std::vector<std::pair<std::string, std::function<std::string()>>> corpora = {
+        {"twitter", [] { return twitterLike(1500); }},
+        {"canada", [] { return canadaLike(110000); }},
+        {"citm_catalog", [] { return citmLike(4000); }},
+        {"deep", [] { return deepNesting(2000, 256); }},
+        {"long_strings", [] { return longStrings(8, 1 << 20); }},
+    };
+    for (auto &c : corpora)
+        if (o.wanted(c.first)) document(o, results, c.first, c.second());
+    if (o.wanted("ndjson")) records(o, results, "ndjson", ndjson(50000));
+    for (const std::string &path : files) {
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        if (!o.wanted(name)) continue;
+        MappedFile f(path);
+        if (f.error) {
+            std::cerr << "bench: cannot read " << path << "\n";
+            return 1;
+        }
+        std::string s(f.view());
+        bool lines = name.size() > 7 && name.compare(name.size() - 7, 7, ".ndjson") == 0;
+        if (lines) records(o, results, name, s);
+        else document(o, results, name, s);
+    }
+    microbenchmarks(o, results);
+    report(o, results);
+    for (const Result &r : results)
+        if (!r.ok) return 1;
+}
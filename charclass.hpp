@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// a 256-bit byte set, usable in constant expressions:
+//     constexpr CharClass hexClass = CharClass::range('0', '9') | CharClass("abcdefABCDEF");
+struct CharClass {
+    uint64_t bits[4] = {0, 0, 0, 0};
+    constexpr CharClass() {}
+    constexpr CharClass(std::string_view cs) {
+        for (char c : cs) set((unsigned char) c);
+    }
+    constexpr CharClass(const char *cs): CharClass(std::string_view(cs)) {}
+    CharClass(const std::string &cs): CharClass(std::string_view(cs)) {}
+    static constexpr CharClass range(unsigned char lo, unsigned char hi) {
+        CharClass r;
+        for (unsigned c = lo; c <= hi; c++) r.set(c);
+        return r;
+    }
+    static constexpr CharClass all() {
+        return ~CharClass();
+    }
+    constexpr void set(unsigned char c) {
+        bits[c >> 6] |= uint64_t(1) << (c & 63);
+    }
+    constexpr bool operator[](unsigned char c) const {
+        return bits[c >> 6] >> (c & 63) & 1;
+    }
+    constexpr bool any() const {
+        return bits[0] | bits[1] | bits[2] | bits[3];
+    }
+    constexpr CharClass operator|(const CharClass &c) const {
+        CharClass r;
+        for (int i = 0; i < 4; i++) r.bits[i] = bits[i] | c.bits[i];
+        return r;
+    }
+    constexpr CharClass operator&(const CharClass &c) const {
+        CharClass r;
+        for (int i = 0; i < 4; i++) r.bits[i] = bits[i] & c.bits[i];
+        return r;
+    }
+    constexpr CharClass operator~() const {
+        CharClass r;
+        for (int i = 0; i < 4; i++) r.bits[i] = ~bits[i];
+        return r;
+    }
+    constexpr bool operator==(const CharClass &c) const {
+        return bits[0] == c.bits[0] && bits[1] == c.bits[1] && bits[2] == c.bits[2] && bits[3] == c.bits[3];
+    }
+};
+
+constexpr CharClass spaceClass(" \n\t");
+constexpr CharClass digitClass = CharClass::range('0', '9');
+
+// counts how many leading bytes of a buffer fall in a class. the class is
+// split into byte ranges up front, and when it has at most eight of them
+// blocks are tested with (x - lo) <= width as unsigned compares, 32 bytes at
+// a time with AVX2 and 16 with SSE2 or NEON; otherwise it is a table loop.
+struct ClassScanner {
+    CharClass cls;
+    int n = 0;
+    unsigned char lo[8] = {}, width[8] = {};
+    constexpr explicit ClassScanner(const CharClass &c): cls(c) {
+        for (unsigned b = 0; b < 256; ) {
+            if (!c[b]) { b++; continue; }
+            unsigned e = b;
+            while (e + 1 < 256 && c[e + 1]) e++;
+            if (n == 8) { n = 9; return; }
+            lo[n] = b;
+            width[n] = e - b;
+            n++;
+            b = e + 1;
+        }
+    }
+    size_t span(const char *p, size_t len) const {
+        size_t i = 0;
+        if (n == 0) return 0;
+        if (n <= 8) i = spanBlocks(p, len);
+        while (i < len && cls[(unsigned char) p[i]]) i++;
+        return i;
+    }
+private:
+    size_t spanBlocks(const char *p, size_t len) const {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 32 <= len; i += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *) (p + i));
+            __m256i m = _mm256_setzero_si256();
+            for (int k = 0; k < n; k++) {
+                __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8((char) lo[k]));
+                m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8((char) width[k])), d));
+            }
+            uint32_t miss = ~(uint32_t) _mm256_movemask_epi8(m);
+            if (miss) return i + __builtin_ctz(miss);
+        }
+#endif
+#if defined(__SSE2__)
+        for (; i + 16 <= len; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *) (p + i));
+            __m128i m = _mm_setzero_si128();
+            for (int k = 0; k < n; k++) {
+                __m128i d = _mm_sub_epi8(x, _mm_set1_epi8((char) lo[k]));
+                m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char) width[k])), d));
+            }
+            uint32_t miss = ~(uint32_t) _mm_movemask_epi8(m) & 0xffff;
+            if (miss) return i + __builtin_ctz(miss);
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 16 <= len; i += 16) {
+            uint8x16_t x = vld1q_u8((const uint8_t *) (p + i));
+            uint8x16_t m = vdupq_n_u8(0);
+            for (int k = 0; k < n; k++)
+                m = vorrq_u8(m, vcleq_u8(vsubq_u8(x, vdupq_n_u8(lo[k])), vdupq_n_u8(width[k])));
+            uint64_t miss = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+            if (miss) return i + (__builtin_ctzll(miss) >> 2);
+        }
+#endif
+        return i;
+    }
+};
+
+// the offset of the first byte in p that does not start a well-formed UTF-8
+// sequence (shortest form, no surrogates, at most U+10FFFF), or len if all
+// of it is valid. ASCII is skipped a vector block at a time; only the
+// multi-byte sequences themselves are checked byte by byte.
+size_t utf8Invalid(const char *p, size_t len) {
+    size_t i = 0;
+    while (true) {
+#if defined(__AVX2__)
+        while (i + 32 <= len && !_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) (p + i)))) i += 32;
+#endif
+#if defined(__SSE2__)
+        while (i + 16 <= len && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (p + i)))) i += 16;
+#elif defined(__ARM_NEON)
+        while (i + 16 <= len && vmaxvq_u8(vld1q_u8((const uint8_t *) (p + i))) < 0x80) i += 16;
+#endif
+        while (i < len && (unsigned char) p[i] < 0x80) i++;
+        if (i == len) return len;
+        unsigned char c = p[i], lo = 0x80, hi = 0xbf;
+        size_t n;
+        if (c >= 0xc2 && c <= 0xdf) n = 2;
+        else if (c >= 0xe0 && c <= 0xef) n = 3;
+        else if (c >= 0xf0 && c <= 0xf4) n = 4;
+        else return i;
+        if (c == 0xe0) lo = 0xa0;
+        else if (c == 0xed) hi = 0x9f;
+        else if (c == 0xf0) lo = 0x90;
+        else if (c == 0xf4) hi = 0x8f;
+        if (len - i < n) return i;
+        unsigned char c1 = p[i + 1];
+        if (c1 < lo || c1 > hi) return i;
+        for (size_t k = 2; k < n; k++)
+            if (((unsigned char) p[i + k] & 0xc0) != 0x80) return i;
+        i += n;
+    }
+}
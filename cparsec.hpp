@@ -1,36 +1,216 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <list>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <array>
 #include <memory>
+#include <memory_resource>
+#include <type_traits>
 #include <functional>
+#include <mutex>
+#include <atomic>
+#include <optional>
 #include <iostream>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include "charclass.hpp"
 
+enum ParseErrorCode : unsigned char {
+    ERR_EOF,
+    ERR_EXPECT_EOF,
+    ERR_UNEXPECT,
+    ERR_EXPECT_CHAR,
+    ERR_EXPECT_DIGIT,
+    ERR_OVERFLOW,
+    ERR_ABORT,
+    ERR_NEED_MORE,
+    ERR_IO,
+    ERR_DEPTH,
+    ERR_ESCAPE,
+    ERR_CAPACITY
+};
+
+// a failure is just a code and an offset, text is only built on demand
+struct ParseError {
+    unsigned long long pos;
+    ParseErrorCode code;
+    char c;
+    // set on a failure past a cut, see commitP
+    bool cut = false;
+    std::string message() const {
+        switch (code) {
+            case ERR_EOF: return "end of file";
+            case ERR_EXPECT_EOF: return "expect end of file";
+            case ERR_UNEXPECT: return "unexpect " + std::string{c};
+            case ERR_EXPECT_CHAR: return "expect " + std::string{c};
+            case ERR_EXPECT_DIGIT: return "expect digit";
+            case ERR_OVERFLOW: return "number out of range";
+            case ERR_ABORT: return "aborted";
+            case ERR_NEED_MORE: return "need more input";
+            case ERR_IO: return "cannot read input";
+            case ERR_DEPTH: return "nested too deep";
+            case ERR_ESCAPE: return "invalid escape";
+            case ERR_CAPACITY: return "input exceeds capacity";
+        }
+        return "";
+    }
+    // a fatal failure ends the parse: no alternative or repetition recovers
+    bool fatal() const {
+        return code == ERR_ABORT || code == ERR_DEPTH || cut;
+    }
+    bool operator==(const ParseError &e) const {
+        return pos == e.pos && code == e.code && c == e.c;
+    }
+};
+
+// input that is still arriving. more(seen) returns everything received so
+// far, of which seen is a prefix at the same address, once that is longer
+// than seen; it returns seen itself when the input has ended. release(pos)
+// says the parse will never look at the input before pos again.
+struct ParseSource {
+    virtual ~ParseSource() {}
+    virtual std::string_view more(std::string_view seen) = 0;
+    virtual void release(unsigned long long) {}
+};
+
+// per-parse settings shared by every state of one parse. memory is where
+// parsers that build results (JSON documents, user ASTs) should allocate;
+// user is whatever the actions of a grammar built once need to reach per
+// parse, such as the handler that receives SAX events. skip is set by skipP.
+// with a source, the end of s.s in a state is not the end of the input.
+// memo is the table memoP caches results in; without one it caches nothing.
+// choices counts the attempts in progress that a failure would return from,
+// the outermost of which started at anchor (see ChoicePoint). tokens is the
+// stream a token grammar runs over (see lexer.hpp), keys the pool JSON
+// object keys are interned in (see jsonp.hpp), profile where namedP rules
+// report to (see profile.hpp).
+struct MemoTable;
+struct TokenStream;
+struct KeyPool;
+struct Profile;
+
+struct ParseContext {
+    ParseSource *source = nullptr;
+    std::vector<ParseError> *trace = nullptr;
+    std::pmr::memory_resource *memory = nullptr;
+    void *user = nullptr;
+    MemoTable *memo = nullptr;
+    const TokenStream *tokens = nullptr;
+    KeyPool *keys = nullptr;
+    Profile *profile = nullptr;
+    unsigned choices = 0;
+    unsigned long long anchor = 0;
+    bool skip = false;
+};
+
+// borrows the input, the caller keeps it alive for as long as the state is used
 struct ParseState
 {
     unsigned long long pos;
-    std::shared_ptr<std::string> s;
-    ParseState(const ParseState &s): pos(s.pos), s(s.s) {}
-    explicit ParseState(const std::string &s): pos(0), s(std::make_shared<std::string>(s)) {}
-    ParseState(unsigned long long p, std::shared_ptr<std::string> s): pos(p), s(s) {}
+    std::string_view s;
+    ParseContext *ctx;
+    explicit ParseState(std::string_view s, ParseContext *ctx = nullptr): pos(0), s(s), ctx(ctx) {}
+    ParseState(unsigned long long p, std::string_view s, ParseContext *ctx = nullptr): pos(p), s(s), ctx(ctx) {}
+    ParseState advance(unsigned long long n) const {
+        return ParseState(pos + n, s, ctx);
+    }
+    std::pmr::memory_resource *memory() const {
+        return ctx && ctx->memory ? ctx->memory : std::pmr::get_default_resource();
+    }
+    // only the input consumed matters here, not the results: combinators
+    // yield a default T instead of computing one wherever T has a default
+    bool skipping() const {
+        return ctx && ctx->skip;
+    }
 };
 
+// held around an attempt that, should it fail without being fatal, sends
+// the parse back to s: an alternative with others left to try, or one turn
+// of a repetition. nothing before the outermost one can be released.
+struct ChoicePoint {
+    ParseContext *ctx;
+    explicit ChoicePoint(const ParseState &s, bool active = true): ctx(active ? s.ctx : nullptr) {
+        if (ctx && !ctx->choices++) ctx->anchor = s.pos;
+    }
+    ChoicePoint(const ChoicePoint &) = delete;
+    ChoicePoint &operator=(const ChoicePoint &) = delete;
+    ~ChoicePoint() {
+        if (ctx) ctx->choices--;
+    }
+};
+
+// asks the source of a growing input for more than s.s holds; false, with s
+// unchanged, at the real end of the input
+bool grow(ParseState &s) {
+    if (!s.ctx || !s.ctx->source) return false;
+    std::string_view t = s.ctx->source->more(s.s);
+    if (t.size() <= s.s.size()) return false;
+    s.s = t;
+    return true;
+}
+
+// makes n bytes from s.pos visible in s.s if the input has them. primitives
+// test the end of input through this (or atEnd), never s.s.size() alone.
+bool ensure(ParseState &s, size_t n) {
+    while (s.s.size() - s.pos < n)
+        if (!grow(s)) return false;
+    return true;
+}
+
+bool atEnd(ParseState &s) {
+    return !ensure(s, 1);
+}
+
+// the length of the run of bytes in sc at s.pos. a run that reaches the end
+// of s.s waits for more input before it is taken to be complete.
+size_t spanAt(const ClassScanner &sc, ParseState &s) {
+    size_t n = sc.span(s.s.data() + s.pos, s.s.size() - s.pos);
+    while (s.pos + n == s.s.size() && grow(s))
+        n += sc.span(s.s.data() + s.pos + n, s.s.size() - s.pos - n);
+    return n;
+}
+
 template<typename T>
 struct ParseResult {
+    using value_type = T;
     bool success;
     union {
-        std::list<std::string> error;
+        ParseError error;
         T result;
     };
     ParseState state;
-    ParseResult(T r, ParseState s): result(r), state(s), success(true) {}
-    ParseResult(ParseState s, std::list<std::string> e): state(s), error(e), success(false) {}
-    ParseResult(const ParseResult &r): state(r.state), success(r.success) {
-        if (r.success) result = r.result;
+    ParseResult(T r, ParseState s): success(true), result(std::move(r)), state(s) {}
+    ParseResult(ParseState s, ParseError e): success(false), error(e), state(s) {}
+    ParseResult(const ParseResult &r): success(r.success), state(r.state) {
+        if (r.success) new (&result) T(r.result);
+        else error = r.error;
+    }
+    ParseResult(ParseResult &&r) noexcept(std::is_nothrow_move_constructible<T>::value): success(r.success), state(r.state) {
+        if (r.success) new (&result) T(std::move(r.result));
         else error = r.error;
     }
+    ParseResult &operator=(const ParseResult &r) {
+        if (this != &r) {
+            this->~ParseResult();
+            new (this) ParseResult(r);
+        }
+        return *this;
+    }
+    ParseResult &operator=(ParseResult &&r) noexcept(std::is_nothrow_move_constructible<T>::value) {
+        if (this != &r) {
+            this->~ParseResult();
+            new (this) ParseResult(std::move(r));
+        }
+        return *this;
+    }
     ~ParseResult() {
-        if (!success) error.~list();
+        if (success) result.~T();
     }
     bool operator==(const ParseResult &s) const {
         if (success != s.success) return false;
@@ -41,38 +221,190 @@ struct ParseResult {
 
 template<typename T>
 ParseResult<T> success(ParseState s, T r) {
-    return ParseResult<T>(r, s);
+    return ParseResult<T>(std::move(r), s);
 }
 
 template<typename T>
-using Parser = std::function<ParseResult<T>(ParseState)>;
+ParseResult<T> failure(ParseState s, ParseErrorCode code, char c = 0) {
+    ParseError e{s.pos, code, c};
+    if (s.ctx && s.ctx->trace) s.ctx->trace->push_back(e);
+    return ParseResult<T>(s, e);
+}
 
+// the bytes a parser can start with. known means it never succeeds without
+// one of them (so never on empty input), trim means leading whitespace is
+// skipped before that byte is looked at.
+struct FirstSet {
+    bool known = false;
+    bool trim = false;
+    CharClass bytes;
+};
+
+// a built parser is never modified by running it: everything a parse
+// changes lives in its ParseState and ParseContext, so one parser (the
+// global ones included) can serve any number of threads at once
 template<typename T>
-ParseResult<T> parse(Parser<T> p, std::string s) {
+struct Parser : std::function<ParseResult<T>(ParseState)> {
+    using std::function<ParseResult<T>(ParseState)>::function;
+    FirstSet first;
+};
+
+template<typename T>
+ParseResult<T> parse(const Parser<T> &p, std::string_view s) {
     return p(ParseState(s));
 }
 
+template<typename T>
+ParseResult<T> parse(const Parser<T> &p, const char *s, size_t n) {
+    return p(ParseState(std::string_view(s, n)));
+}
+
+template<typename T>
+ParseResult<T> parse(const Parser<T> &p, std::string_view s, ParseContext &ctx) {
+    return p(ParseState(s, &ctx));
+}
+
+// a container for results, built on the state's memory resource when it is
+// an allocator-aware pmr type
+template<typename C>
+C newIn(ParseState s) {
+    if constexpr (std::is_constructible_v<C, std::pmr::memory_resource *>) return C(s.memory());
+    else return C();
+}
+
+// reruns a failed parse recording every failure, and describes everything
+// that was expected at the furthest offset reached; empty if p succeeds
+template<typename T>
+std::string explain(const Parser<T> &p, std::string_view s) {
+    std::vector<ParseError> trace;
+    ParseContext ctx;
+    ctx.trace = &trace;
+    if (p(ParseState(s, &ctx)).success) return "";
+    unsigned long long pos = 0;
+    for (const ParseError &e : trace) pos = std::max(pos, e.pos);
+    std::string msg = "offset " + std::to_string(pos) + ": unexpect ";
+    msg += pos < s.size() ? "'" + std::string{s[pos]} + "'" : "end of file";
+    std::vector<std::string> expect;
+    for (const ParseError &e : trace) {
+        if (e.pos != pos) continue;
+        std::string x;
+        if (e.code == ERR_EXPECT_CHAR) x = "'" + std::string{e.c} + "'";
+        else if (e.code == ERR_EXPECT_DIGIT) x = "digit";
+        else if (e.code == ERR_EXPECT_EOF) x = "end of file";
+        else continue;
+        if (std::find(expect.begin(), expect.end(), x) == expect.end()) expect.push_back(x);
+    }
+    for (size_t i = 0; i < expect.size(); i++) msg += (i ? " or " : ", expect ") + expect[i];
+    return msg;
+}
+
 template<typename A, typename B>
 Parser<B> mapP(Parser<A> p, std::function<B(A)> f) {
-    return [=] (ParseState s) {
+    Parser<B> q = [=] (ParseState s) {
         ParseResult<A> r = p(s);
         if (!r.success) return ParseResult<B>(r.state, r.error);
-        return success(r.state, f(r.result));
+        if constexpr (std::is_default_constructible_v<B>)
+            if (r.state.skipping()) return success(r.state, B());
+        return success(r.state, f(std::move(r.result)));
+    };
+    q.first = p.first;
+    return q;
+}
+
+const ClassScanner spaceScanner(spaceClass);
+const ClassScanner digitScanner(digitClass);
+
+ParseState skipSpace(ParseState s) {
+    s.pos += spanAt(spaceScanner, s);
+    return s;
+}
+
+// tries each alternative in turn. on failure keeps whichever got furthest,
+// so the report points at the most plausible branch without building anything
+template<typename T>
+Parser<T> seqOrP(std::vector<Parser<T>> ps) {
+    if (ps.size() == 1) return ps[0];
+    return [=] (ParseState s) {
+        ParseResult<T> r = [&] {
+            ChoicePoint c(s);
+            return ps[0](s);
+        }();
+        for (size_t i = 1; i < ps.size() && !r.success && !r.error.fatal(); i++) {
+            ChoicePoint c(s, i + 1 < ps.size());
+            ParseResult<T> rq = ps[i](s);
+            if (rq.success || rq.error.fatal() || rq.error.pos >= r.error.pos) r = std::move(rq);
+        }
+        return r;
     };
 }
 
+// looks at the next byte (after whitespace if trim) and runs only the cases
+// whose byte set contains it, in order. while explain() is tracing, every
+// case is tried so the expected set stays complete.
+template<typename T>
+Parser<T> dispatchP(std::vector<std::pair<CharClass, Parser<T>>> cases, bool trim) {
+    std::vector<Parser<T>> all;
+    for (const auto &c : cases) all.push_back(c.second);
+    Parser<T> seq = seqOrP(all);
+    std::array<unsigned char, 256> slot{};
+    std::vector<Parser<T>> groups(1);
+    std::vector<std::vector<size_t>> keys(1);
+    FirstSet first;
+    first.known = true;
+    first.trim = trim;
+    for (int b = 0; b < 256; b++) {
+        std::vector<size_t> key;
+        for (size_t i = 0; i < cases.size(); i++)
+            if (cases[i].first[b]) key.push_back(i);
+        if (key.empty()) continue;
+        first.bytes.set(b);
+        size_t g = std::find(keys.begin(), keys.end(), key) - keys.begin();
+        if (g == keys.size()) {
+            if (g == 256) return seq;
+            std::vector<Parser<T>> ps;
+            for (size_t i : key) ps.push_back(cases[i].second);
+            keys.push_back(key);
+            groups.push_back(seqOrP(ps));
+        }
+        slot[b] = g;
+    }
+    Parser<T> q = [=] (ParseState s) {
+        if (trim) s = skipSpace(s);
+        if (s.ctx && s.ctx->trace) return seq(s);
+        if (atEnd(s)) return failure<T>(s, ERR_EOF);
+        unsigned char c = s.s[s.pos];
+        if (!slot[c]) return failure<T>(s, ERR_UNEXPECT, c);
+        return groups[slot[c]](s);
+    };
+    q.first = first;
+    return q;
+}
+
+// maps the next byte (after whitespace if trim, which is consumed) to the
+// case listing it. a byte listed by several cases tries them in order.
+template<typename T>
+Parser<T> switchP(std::vector<std::pair<std::string, Parser<T>>> cases, bool trim = false) {
+    std::vector<std::pair<CharClass, Parser<T>>> cs;
+    for (const auto &c : cases) cs.push_back(std::make_pair(CharClass(c.first), c.second));
+    return dispatchP(cs, trim);
+}
+
 template<typename T>
 Parser<T> orP(Parser<T> p) {
     return p;
 }
 
+// when every alternative has a known first set (and they agree on trim) the
+// choice becomes a byte-indexed dispatch, otherwise alternatives run in turn
 template<typename T, typename... Args>
 Parser<T> orP(Parser<T> p, Args... ps) {
-    return [=] (ParseState s) -> ParseResult<T> {
-        ParseResult<T> r = p(s);
-        if (!r.success) return orP(ps...)(s);
-        return r;
-    };
+    std::vector<Parser<T>> alts{p, ps...};
+    bool known = true;
+    for (const Parser<T> &a : alts) known &= a.first.known && a.first.trim == p.first.trim;
+    if (!known) return seqOrP(alts);
+    std::vector<std::pair<CharClass, Parser<T>>> cases;
+    for (const Parser<T> &a : alts) cases.push_back(std::make_pair(a.first.bytes, a));
+    return dispatchP(cases, p.first.trim);
 }
 
 template<typename T>
@@ -84,13 +416,17 @@ Parser<T> pureP(T x) {
 
 template<typename A, typename B, typename C>
 Parser<C> andP(Parser<A> pa, Parser<B> pb, std::function<C(A, B)> f) {
-    return [=] (ParseState s) {
+    Parser<C> q = [=] (ParseState s) {
         ParseResult<A> ra = pa(s);
         if (!ra.success) return ParseResult<C>(ra.state, ra.error);
         ParseResult<B> rb = pb(ra.state);
         if (!rb.success) return ParseResult<C>(rb.state, rb.error);
-        return success(rb.state, f(ra.result, rb.result));
+        if constexpr (std::is_default_constructible_v<C>)
+            if (rb.state.skipping()) return success(rb.state, C());
+        return success(rb.state, f(std::move(ra.result), std::move(rb.result)));
     };
+    q.first = pa.first;
+    return q;
 }
 
 template<typename A, typename B>
@@ -103,88 +439,446 @@ Parser<B> rightP(Parser<A> pa, Parser<B> pb) {
     return andP<A, B, B>(pa, pb, [] (A a, B b) { return b; });
 }
 
+// runs p until it fails or stops consuming input, handing each result to f,
+// and succeeds with the state after the last match. a fatal failure of p is
+// not the end of the repetition but of the whole parse, so it is returned.
+// while skipping nothing is handed over, so nothing is collected.
+template<typename T, typename F>
+ParseResult<bool> manyLoop(const Parser<T> &p, ParseState s, F &&f) {
+    bool keep = !s.skipping();
+    while (true) {
+        ChoicePoint c(s);
+        ParseResult<T> r = p(s);
+        if (!r.success && r.error.fatal()) return ParseResult<bool>(r.state, r.error);
+        if (!r.success || r.state.pos == s.pos) return success(s, true);
+        if (keep) f(std::move(r.result));
+        s = r.state;
+    }
+}
+
+template<typename T, typename Acc>
+Parser<Acc> foldP(Parser<T> p, Acc init, std::function<void(Acc &, T)> f) {
+    return [=] (ParseState s) {
+        Acc acc = init;
+        ParseResult<bool> m = manyLoop(p, s, [&] (T x) { f(acc, std::move(x)); });
+        if (!m.success) return ParseResult<Acc>(m.state, m.error);
+        return success(m.state, std::move(acc));
+    };
+}
+
+template<typename T, typename Acc>
+Parser<Acc> fold1P(Parser<T> p, Acc init, std::function<void(Acc &, T)> f) {
+    Parser<Acc> q = [=] (ParseState s) {
+        ParseResult<T> r = p(s);
+        if (!r.success) return ParseResult<Acc>(r.state, r.error);
+        Acc acc = init;
+        f(acc, std::move(r.result));
+        ParseResult<bool> m = manyLoop(p, r.state, [&] (T x) { f(acc, std::move(x)); });
+        if (!m.success) return ParseResult<Acc>(m.state, m.error);
+        return success(m.state, std::move(acc));
+    };
+    q.first = p.first;
+    return q;
+}
+
 template<typename T>
 Parser<std::list<T>> manyP(Parser<T> p) {
     return [=] (ParseState s) {
-        ParseResult<T> r = p(s);
-        if (!r.success) return success(s, std::list<T>());
-        ParseResult<std::list<T>> rs = manyP(p)(r.state);
-        rs.result.push_front(r.result);
-        return success(rs.state, rs.result);
+        std::list<T> xs;
+        ParseResult<bool> m = manyLoop(p, s, [&] (T x) { xs.push_back(std::move(x)); });
+        if (!m.success) return ParseResult<std::list<T>>(m.state, m.error);
+        return success(m.state, std::move(xs));
     };
 }
 
 template<typename T>
 Parser<std::list<T>> someP(Parser<T> p) {
-    return andP<T, std::list<T>, std::list<T>>(p, manyP(p), [] (T r, std::list<T> rs) {
-        rs.push_front(r);
-        return rs;
+    Parser<std::list<T>> q = [=] (ParseState s) {
+        ParseResult<T> r = p(s);
+        if (!r.success) return ParseResult<std::list<T>>(r.state, r.error);
+        std::list<T> xs;
+        xs.push_back(std::move(r.result));
+        ParseResult<bool> m = manyLoop(p, r.state, [&] (T x) { xs.push_back(std::move(x)); });
+        if (!m.success) return ParseResult<std::list<T>>(m.state, m.error);
+        return success(m.state, std::move(xs));
+    };
+    q.first = p.first;
+    return q;
+}
+
+template<typename T>
+Parser<std::vector<T>> manyVecP(Parser<T> p, size_t reserve = 0) {
+    return [=] (ParseState s) {
+        std::vector<T> xs = newIn<std::vector<T>>(s);
+        xs.reserve(reserve);
+        ParseResult<bool> m = manyLoop(p, s, [&] (T x) { xs.push_back(std::move(x)); });
+        if (!m.success) return ParseResult<std::vector<T>>(m.state, m.error);
+        return success(m.state, std::move(xs));
+    };
+}
+
+Parser<std::string> manyStrP(Parser<char> p) {
+    return [=] (ParseState s) {
+        std::string xs;
+        ParseResult<bool> m = manyLoop(p, s, [&] (char c) { xs.push_back(c); });
+        if (!m.success) return ParseResult<std::string>(m.state, m.error);
+        return success(m.state, std::move(xs));
+    };
+}
+
+Parser<std::string> someStrP(Parser<char> p) {
+    Parser<std::string> q = [=] (ParseState s) {
+        ParseResult<char> r = p(s);
+        if (!r.success) return ParseResult<std::string>(r.state, r.error);
+        std::string xs(1, r.result);
+        ParseResult<bool> m = manyLoop(p, r.state, [&] (char c) { xs.push_back(c); });
+        if (!m.success) return ParseResult<std::string>(m.state, m.error);
+        return success(m.state, std::move(xs));
+    };
+    q.first = p.first;
+    return q;
+}
+
+// zero or more p separated by sep, collected into C
+template<typename T, typename S, typename C = std::vector<T>>
+Parser<C> sepByP(Parser<T> p, Parser<S> sep) {
+    Parser<T> next = rightP<S, T>(sep, p);
+    return [=] (ParseState s) {
+        C xs = newIn<C>(s);
+        ParseResult<T> r = [&] {
+            ChoicePoint c(s);
+            return p(s);
+        }();
+        if (!r.success && r.error.fatal()) return ParseResult<C>(r.state, r.error);
+        if (!r.success) return success(s, std::move(xs));
+        if (!s.skipping()) xs.push_back(std::move(r.result));
+        ParseResult<bool> m = manyLoop(next, r.state, [&] (T x) { xs.push_back(std::move(x)); });
+        if (!m.success) return ParseResult<C>(m.state, m.error);
+        return success(m.state, std::move(xs));
+    };
+}
+
+// one or more p separated by op, combined left to right: 10-2-3 is
+// (10-2)-3. the operands are folded in a loop, not by recursion, and an
+// op that is not followed by a p is left unconsumed.
+template<typename T>
+Parser<T> chainl1P(Parser<T> p, Parser<std::function<T(T, T)>> op) {
+    using F = std::function<T(T, T)>;
+    Parser<std::pair<F, T>> next = andP<F, T, std::pair<F, T>>(op, p, [] (F f, T y) {
+        return std::make_pair(std::move(f), std::move(y));
+    });
+    Parser<T> q = [=] (ParseState s) {
+        ParseResult<T> r = p(s);
+        if (!r.success) return r;
+        T acc = std::move(r.result);
+        ParseResult<bool> m = manyLoop(next, r.state, [&] (std::pair<F, T> x) {
+            acc = x.first(std::move(acc), std::move(x.second));
+        });
+        if (!m.success) return ParseResult<T>(m.state, m.error);
+        return success(m.state, std::move(acc));
+    };
+    q.first = p.first;
+    return q;
+}
+
+// the same, combined right to left: 2^3^2 is 2^(3^2)
+template<typename T>
+Parser<T> chainr1P(Parser<T> p, Parser<std::function<T(T, T)>> op) {
+    using F = std::function<T(T, T)>;
+    Parser<std::pair<F, T>> next = andP<F, T, std::pair<F, T>>(op, p, [] (F f, T y) {
+        return std::make_pair(std::move(f), std::move(y));
     });
+    Parser<T> q = [=] (ParseState s) {
+        ParseResult<T> r = p(s);
+        if (!r.success) return r;
+        std::vector<T> xs;
+        std::vector<F> fs;
+        xs.push_back(std::move(r.result));
+        ParseResult<bool> m = manyLoop(next, r.state, [&] (std::pair<F, T> x) {
+            fs.push_back(std::move(x.first));
+            xs.push_back(std::move(x.second));
+        });
+        if (!m.success) return ParseResult<T>(m.state, m.error);
+        T acc = std::move(xs.back());
+        for (size_t i = fs.size(); i-- > 0; ) acc = fs[i](std::move(xs[i]), std::move(acc));
+        return success(m.state, std::move(acc));
+    };
+    q.first = p.first;
+    return q;
 }
 
-Parser<char> idP = [] (ParseState s) {
-    if (s.pos == s.s->size()) 
-        return ParseResult<char>(s, std::list<std::string>{"end of file"});
-    else return success(ParseState(s.pos + 1, s.s), s.s->at(s.pos));
+template<typename T>
+Parser<size_t> countP(Parser<T> p) {
+    return [=] (ParseState s) {
+        size_t n = 0;
+        ParseResult<bool> m = manyLoop(p, s, [&] (T) { n++; });
+        if (!m.success) return ParseResult<size_t>(m.state, m.error);
+        return success(m.state, n);
+    };
+}
+
+Parser<char> anyP() {
+    Parser<char> p = [] (ParseState s) {
+        if (atEnd(s)) return failure<char>(s, ERR_EOF);
+        else return success(s.advance(1), s.s[s.pos]);
+    };
+    p.first.known = true;
+    p.first.bytes = CharClass::all();
+    return p;
+}
+
+const Parser<char> idP = anyP();
+
+// consumes nothing and yields the memory resource of this parse, so mapP /
+// andP callbacks can allocate their results next to everything else
+const Parser<std::pmr::memory_resource *> memoryP = [] (ParseState s) {
+    return success(s, s.memory());
 };
 
-Parser<bool> eofP = [] (ParseState s) {
-    if (s.pos == s.s->size()) return success(s, true);
-    else return ParseResult<bool>(s, std::list<std::string>{"expect end of file"});
+const Parser<bool> eofP = [] (ParseState s) {
+    if (atEnd(s)) return success(s, true);
+    else return failure<bool>(s, ERR_EXPECT_EOF);
 };
 
+// f is taken to be pure: it is tabulated once up front for the first set
 Parser<char> predP(std::function<bool(char)> f) {
-    return [=] (ParseState s) {
-        ParseResult<char> r = idP(s);
-        if (!r.success) return ParseResult<char>(r.state, r.error);
-        if (!f(r.result)) 
-            return ParseResult<char>(r.state, std::list<std::string>{"unexpect " + std::string{r.result}});
-        return r;
+    Parser<char> p = [=] (ParseState s) {
+        if (atEnd(s)) return failure<char>(s, ERR_EOF);
+        char c = s.s[s.pos];
+        if (!f(c)) return failure<char>(s, ERR_UNEXPECT, c);
+        return success(s.advance(1), c);
     };
+    p.first.known = true;
+    for (int c = 0; c < 256; c++)
+        if (f((char) c)) p.first.bytes.set(c);
+    return p;
 }
 
 Parser<char> charP(char c) {
-    return predP([=] (char x) { return c == x; });
+    Parser<char> p = [=] (ParseState s) {
+        if (atEnd(s) || s.s[s.pos] != c) return failure<char>(s, ERR_EXPECT_CHAR, c);
+        return success(s.advance(1), c);
+    };
+    p.first.known = true;
+    p.first.bytes.set((unsigned char) c);
+    return p;
 }
 
-Parser<char> oneOfP(std::string s) {
-    return predP([=] (char c) {
-        bool t = false;
-        for (int i = 0; i < s.size(); i++) t |= c == s[i];
-        return t;
-    });
+Parser<char> oneOfP(CharClass cls) {
+    Parser<char> p = [=] (ParseState s) {
+        if (atEnd(s)) return failure<char>(s, ERR_EOF);
+        char c = s.s[s.pos];
+        if (!cls[c]) return failure<char>(s, ERR_UNEXPECT, c);
+        return success(s.advance(1), c);
+    };
+    p.first.known = true;
+    p.first.bytes = cls;
+    return p;
 }
 
-Parser<std::string> stringP(std::string str) {
+// the run of bytes in cls starting here, as a view into the input
+Parser<std::string_view> spanP(CharClass cls) {
+    ClassScanner sc(cls);
+    return [=] (ParseState s) {
+        size_t n = spanAt(sc, s);
+        return success(s.advance(n), s.s.substr(s.pos, n));
+    };
+}
+
+Parser<std::string_view> span1P(CharClass cls) {
+    ClassScanner sc(cls);
+    Parser<std::string_view> p = [=] (ParseState s) {
+        size_t n = spanAt(sc, s);
+        if (n == 0) {
+            if (atEnd(s)) return failure<std::string_view>(s, ERR_EOF);
+            return failure<std::string_view>(s, ERR_UNEXPECT, s.s[s.pos]);
+        }
+        return success(s.advance(n), s.s.substr(s.pos, n));
+    };
+    p.first.known = true;
+    p.first.bytes = cls;
+    return p;
+}
+
+Parser<size_t> skipWhileP(CharClass cls) {
+    ClassScanner sc(cls);
     return [=] (ParseState s) {
-        if (str == "") return success(s, std::string(""));
-        ParseResult<char> r = charP(str.front())(s);
+        size_t n = spanAt(sc, s);
+        return success(s.advance(n), n);
+    };
+}
+
+// one bounded compare; the mismatch offset is only looked for on failure
+ParseResult<std::string_view> literalAt(ParseState s, std::string_view lit) {
+    ensure(s, lit.size());
+    std::string_view in = s.s.substr(s.pos, lit.size());
+    if (in == lit) return success(s.advance(lit.size()), in);
+    size_t i = 0;
+    while (i < in.size() && in[i] == lit[i]) i++;
+    return failure<std::string_view>(s.advance(i), ERR_EXPECT_CHAR, lit[i]);
+}
+
+Parser<std::string_view> literalP(std::string lit) {
+    Parser<std::string_view> p = [=] (ParseState s) {
+        return literalAt(s, lit);
+    };
+    if (!lit.empty()) {
+        p.first.known = true;
+        p.first.bytes.set((unsigned char) lit[0]);
+    }
+    return p;
+}
+
+Parser<std::string> stringP(std::string str) {
+    Parser<std::string> p = [=] (ParseState s) {
+        ParseResult<std::string_view> r = literalAt(s, str);
         if (!r.success) return ParseResult<std::string>(r.state, r.error);
-        ParseResult<std::string> rs = stringP(std::string(str.begin() + 1, str.end()))(r.state);
-        if (!rs.success) return rs;
-        return success(rs.state, str);
+        return success(r.state, str);
     };
+    p.first = literalP(str).first;
+    return p;
 }
 
-Parser<char> space = oneOfP(" \n\t");
-Parser<std::list<char>> spaces = manyP(space);
-Parser<int> digitP = mapP<char, int>(predP([] (char c) { return '0' <= c && c <= '9'; }), 
-                                     [] (char c) { return c - '0'; });
-Parser<int> natP = mapP<std::list<int>, int>(someP(digitP), [] (std::list<int> ns) {
-    int n = 0;
-    for (int i : ns) n = n * 10 + i;
-    return n;
-});
-Parser<int> intP = orP(mapP<int, int>(rightP(charP('-'), natP), [] (int x) { return -x; }), natP);
-Parser<double> doubleP = orP(andP<int, double, double>(intP, rightP<char, double>(charP('.'), 
-    mapP<std::list<int>, double>(someP(digitP), [] (std::list<int> ns) {
-        double ans = 0, base = 0.1;
-        for (int i : ns) {
-            ans += i * base;
-            base /= 10;
+// matches the longest of several literals through a trie and returns its
+// index in words
+Parser<size_t> keywordsP(std::vector<std::string> words) {
+    struct Node {
+        long word = -1;
+        std::string edges;
+        std::vector<size_t> next;
+    };
+    std::vector<Node> trie(1);
+    std::array<size_t, 256> root{};
+    for (size_t w = 0; w < words.size(); w++) {
+        size_t n = 0;
+        for (size_t i = 0; i < words[w].size(); i++) {
+            unsigned char c = words[w][i];
+            size_t *slot = nullptr;
+            if (n == 0) slot = &root[c];
+            else {
+                size_t e = trie[n].edges.find((char) c);
+                if (e != std::string::npos) slot = &trie[n].next[e];
+            }
+            if (slot && *slot) {
+                n = *slot;
+                continue;
+            }
+            trie.push_back(Node());
+            if (n == 0) root[c] = trie.size() - 1;
+            else {
+                trie[n].edges.push_back((char) c);
+                trie[n].next.push_back(trie.size() - 1);
+            }
+            n = trie.size() - 1;
+        }
+        if (n != 0 && trie[n].word < 0) trie[n].word = w;
+    }
+    Parser<size_t> p = [=] (ParseState s) {
+        long word = -1;
+        unsigned long long pos = s.pos, end = s.pos;
+        size_t n = !atEnd(s) ? root[(unsigned char) s.s[pos]] : 0;
+        while (n) {
+            pos++;
+            if (trie[n].word >= 0) {
+                word = trie[n].word;
+                end = pos;
+            }
+            if (pos == s.s.size() && !grow(s)) break;
+            size_t e = trie[n].edges.find(s.s[pos]);
+            n = e == std::string::npos ? 0 : trie[n].next[e];
+        }
+        if (word < 0) {
+            if (pos == s.s.size()) return failure<size_t>(ParseState(pos, s.s, s.ctx), ERR_EOF);
+            return failure<size_t>(ParseState(pos, s.s, s.ctx), ERR_UNEXPECT, s.s[pos]);
+        }
+        return success(ParseState(end, s.s, s.ctx), (size_t) word);
+    };
+    p.first.known = true;
+    for (int c = 0; c < 256; c++)
+        if (root[c]) p.first.bytes.set(c);
+    return p;
+}
+
+const Parser<char> space = oneOfP(spaceClass);
+const Parser<size_t> spaces = skipWhileP(spaceClass);
+const Parser<int> digitP = mapP<char, int>(oneOfP(digitClass), [] (char c) { return c - '0'; });
+// a digit run, with a leading '-' if sign, converted by from_chars in one
+// pass. values that do not fit T fail with ERR_OVERFLOW instead of wrapping.
+template<typename T>
+Parser<T> integralP(bool sign) {
+    Parser<T> p = [=] (ParseState s) {
+        unsigned long long d = sign && !atEnd(s) && s.s[s.pos] == '-';
+        ParseState t = s.advance(d);
+        if (atEnd(t)) return failure<T>(t, ERR_EOF);
+        if (!digitClass[t.s[t.pos]]) return failure<T>(t, ERR_EXPECT_DIGIT);
+        size_t n = spanAt(digitScanner, t);
+        const char *b = t.s.data() + s.pos;
+        T x;
+        std::from_chars_result r = std::from_chars(b, b + d + n, x);
+        if (r.ec != std::errc()) return failure<T>(s, ERR_OVERFLOW);
+        return success(ParseState(s.pos + (r.ptr - b), t.s, s.ctx), x);
+    };
+    p.first.known = true;
+    p.first.bytes = sign ? digitClass | CharClass("-") : digitClass;
+    return p;
+}
+
+// the length of a JSON number -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+// at s, or the failure at the first byte that breaks it
+ParseResult<size_t> numberSpan(ParseState s) {
+    ParseState t = s;
+    auto peek = [&] (char c) {
+        return !atEnd(t) && t.s[t.pos] == c;
+    };
+    auto digits = [&] () {
+        size_t n = spanAt(digitScanner, t);
+        t.pos += n;
+        return n > 0;
+    };
+    auto bad = [&] () {
+        return failure<size_t>(t, atEnd(t) ? ERR_EOF : ERR_EXPECT_DIGIT);
+    };
+    if (peek('-')) t.pos++;
+    if (peek('0')) t.pos++;
+    else if (!digits()) return bad();
+    if (peek('.')) {
+        t.pos++;
+        if (!digits()) return bad();
+    }
+    if (peek('e') || peek('E')) {
+        t.pos++;
+        if (peek('+') || peek('-')) t.pos++;
+        if (!digits()) return bad();
+    }
+    return success(t, (size_t) (t.pos - s.pos));
+}
+
+// from_chars is correctly rounded (an Eisel-Lemire fast path in current
+// standard libraries); only values past the double range take the strtod
+// path, which tells overflow (an error) from underflow (rounds to zero)
+Parser<double> numberP() {
+    Parser<double> p = [] (ParseState s) {
+        ParseResult<size_t> n = numberSpan(s);
+        if (!n.success) return ParseResult<double>(n.state, n.error);
+        const char *b = n.state.s.data() + s.pos;
+        double x;
+        std::from_chars_result r = std::from_chars(b, b + n.result, x);
+        if (r.ec == std::errc::result_out_of_range) {
+            x = std::strtod(std::string(b, n.result).c_str(), nullptr);
+            if (std::isinf(x)) return failure<double>(s, ERR_OVERFLOW);
         }
-        return ans;
-    })), [] (int x, double y) { return x + y; }), mapP<int, double>(intP, [] (int x) { return x; }));
+        return success(n.state, x);
+    };
+    p.first.known = true;
+    p.first.bytes = digitClass | CharClass("-");
+    return p;
+}
+
+const Parser<int> natP = integralP<int>(false);
+const Parser<int> intP = integralP<int>(true);
+const Parser<int64_t> int64P = integralP<int64_t>(true);
+const Parser<uint64_t> uint64P = integralP<uint64_t>(false);
+const Parser<double> doubleP = numberP();
 
 template<typename A, typename B, typename C>
 Parser<C> betweenP(Parser<A> lp, Parser<B> rp, Parser<C> p) {
@@ -193,10 +887,203 @@ Parser<C> betweenP(Parser<A> lp, Parser<B> rp, Parser<C> p) {
 
 template<typename T>
 Parser<T> trimP(Parser<T> p) {
-    return rightP<std::list<char>, T>(spaces, leftP<T, std::list<char>>(p, spaces));
+    Parser<T> q = rightP<size_t, T>(spaces, leftP<T, size_t>(p, spaces));
+    q.first = p.first;
+    q.first.trim = true;
+    return q;
+}
+
+// runs p in skip mode for the input it consumes, which it yields. every
+// combinator inside p advances as usual but builds no results.
+template<typename T>
+Parser<std::string_view> skipP(Parser<T> p) {
+    Parser<std::string_view> q = [=] (ParseState s) {
+        ParseContext sub = s.ctx ? *s.ctx : ParseContext();
+        sub.skip = true;
+        ParseResult<T> r = p(ParseState(s.pos, s.s, &sub));
+        ParseState t(r.state.pos, r.state.s, s.ctx);
+        if (!r.success) return ParseResult<std::string_view>(t, r.error);
+        return success(t, t.s.substr(s.pos, t.pos - s.pos));
+    };
+    q.first = p.first;
+    return q;
+}
+
+// the packrat table of one parse: for every memoP rule, the results at the
+// last window positions it ran at, in a ring indexed by offset. a result
+// further back than that is overwritten and computed again if asked for,
+// so memory stays bounded however long the input is. entries are tied to
+// the input buffer they were made for; clear() before reusing a table on
+// a buffer whose contents have changed.
+struct MemoTable {
+    explicit MemoTable(size_t window = 1 << 12) {
+        size_t n = 1;
+        while (n < window) n <<= 1;
+        mask = n - 1;
+    }
+    MemoTable(const MemoTable &) = delete;
+    MemoTable &operator=(const MemoTable &) = delete;
+    template<typename T>
+    const ParseResult<T> *find(size_t rule, ParseState s) {
+        if (rule >= columns.size() || !columns[rule]) return nullptr;
+        Slot<T> &e = static_cast<Column<T> &>(*columns[rule]).slots[s.pos & mask];
+        return e.result && e.pos == s.pos && e.pos >= floor && e.input == s.s.data() && e.skip == s.skipping() ? &*e.result : nullptr;
+    }
+    template<typename T>
+    void store(size_t rule, ParseState s, const ParseResult<T> &r) {
+        if (rule >= columns.size()) columns.resize(rule + 1);
+        if (!columns[rule]) columns[rule] = std::make_unique<Column<T>>(mask + 1);
+        Slot<T> &e = static_cast<Column<T> &>(*columns[rule]).slots[s.pos & mask];
+        e.pos = s.pos;
+        e.input = s.s.data();
+        e.skip = s.skipping();
+        e.result.emplace(r);
+    }
+    // forgets everything, keeping the rings for the next parse
+    void clear() {
+        for (auto &c : columns)
+            if (c) c->clear(~0ULL);
+        floor = swept = 0;
+    }
+    // the parse will not come back before pos: those entries are dead, and
+    // are destroyed once a window's worth of them has piled up
+    void release(unsigned long long pos) {
+        if (pos <= floor) return;
+        floor = pos;
+        if (floor - swept <= mask) return;
+        for (auto &c : columns)
+            if (c) c->clear(floor);
+        swept = floor;
+    }
+private:
+    template<typename T>
+    struct Slot {
+        unsigned long long pos = 0;
+        const char *input = nullptr;
+        bool skip = false;
+        std::optional<ParseResult<T>> result;
+    };
+    // clear(before) drops the entries at offsets below before
+    struct ColumnBase {
+        virtual ~ColumnBase() {}
+        virtual void clear(unsigned long long before) = 0;
+    };
+    template<typename T>
+    struct Column : ColumnBase {
+        explicit Column(size_t n): slots(n) {}
+        void clear(unsigned long long before) override {
+            for (Slot<T> &e : slots)
+                if (e.pos < before) e.result.reset();
+        }
+        std::vector<Slot<T>> slots;
+    };
+    std::vector<std::unique_ptr<ColumnBase>> columns;
+    size_t mask;
+    unsigned long long floor = 0, swept = 0;
+};
+
+size_t nextMemoRule() {
+    static std::atomic<size_t> n{0};
+    return n++;
+}
+
+// p with its result at each offset cached in the parse's MemoTable, so an
+// alternative that backtracks over it, or a grammar that reaches it from
+// several places, does not parse that stretch again. this turns PEG-style
+// grammars linear, at the cost of a copy of the result per hit: memoize
+// rules whose results are cheap to copy. traced parses are not cached, so
+// explain() still sees every failure.
+//     MemoTable memo;
+//     ParseContext ctx;
+//     ctx.memo = &memo;
+//     parse(p, s, ctx);
+template<typename T>
+Parser<T> memoP(Parser<T> p) {
+    size_t rule = nextMemoRule();
+    Parser<T> q = [=] (ParseState s) {
+        if (!s.ctx || !s.ctx->memo || s.ctx->trace) return p(s);
+        if (const ParseResult<T> *hit = s.ctx->memo->find<T>(rule, s)) {
+            ParseResult<T> r = *hit;
+            if (r.state.s.size() < s.s.size()) r.state.s = s.s;
+            r.state.ctx = s.ctx;
+            return r;
+        }
+        ParseResult<T> r = p(s);
+        s.ctx->memo->store(rule, s, r);
+        return r;
+    };
+    q.first = p.first;
+    return q;
 }
 
+// p, with its failure made fatal: no enclosing alternative or repetition
+// tries anything else, so a malformed input fails where it stopped making
+// sense instead of after every other reading of it has been tried
+template<typename T>
+Parser<T> commitP(Parser<T> p) {
+    Parser<T> q = [=] (ParseState s) {
+        ParseResult<T> r = p(s);
+        if (!r.success) r.error.cut = true;
+        return r;
+    };
+    q.first = p.first;
+    return q;
+}
+
+// p then q, yielding q, with q committed once p has matched: after
+//     cutP(charP('{'), members)
+// a bad member is the error of the whole parse. passing the cut also tells
+// the memo table and the input source what the parse can no longer return
+// to: everything before the cut, or before the outermost pending choice
+// when one encloses it.
+template<typename A, typename B>
+Parser<B> cutP(Parser<A> p, Parser<B> q) {
+    Parser<B> c = commitP(q);
+    Parser<B> r = [=] (ParseState s) {
+        ParseResult<A> a = p(s);
+        if (!a.success) return ParseResult<B>(a.state, a.error);
+        if (ParseContext *ctx = a.state.ctx) {
+            unsigned long long pos = ctx->choices ? std::min(ctx->anchor, a.state.pos) : a.state.pos;
+            if (ctx->memo) ctx->memo->release(pos);
+            if (ctx->source) ctx->source->release(pos);
+        }
+        return c(a.state);
+    };
+    r.first = p.first;
+    return r;
+}
+
+// f runs once, on first use, rather than on every parse step
 template<typename T>
 Parser<T> lazyP(std::function<Parser<T>()> f) {
-    return [=] (ParseState s) { return f()(s); };
+    struct Cell {
+        std::once_flag once;
+        Parser<T> p;
+    };
+    std::shared_ptr<Cell> c = std::make_shared<Cell>();
+    return [=] (ParseState s) {
+        std::call_once(c->once, [&] { c->p = f(); });
+        return c->p(s);
+    };
+}
+
+// a slot for a parser that is built once and referenced by handle, so rules
+// can refer to each other (or themselves) before they are defined. the rule
+// must outlive every parser that references it. a reference takes the first
+// set of the rule as defined at the time ruleP is called.
+template<typename T>
+struct Rule {
+    std::unique_ptr<Parser<T>> p = std::make_unique<Parser<T>>();
+    Rule &operator=(Parser<T> q) {
+        *p = std::move(q);
+        return *this;
+    }
+};
+
+template<typename T>
+Parser<T> ruleP(const Rule<T> &r) {
+    const Parser<T> *p = r.p.get();
+    Parser<T> q = [p] (ParseState s) { return (*p)(s); };
+    q.first = p->first;
+    return q;
 }
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include <string_view>
+#include <optional>
+#include <new>
+#include <cstring>
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <ucontext.h>
+
+// parses input that arrives in pieces, such as a message read off a socket.
+// the parse runs on a stack of its own and, whenever a parser needs bytes
+// past what has been fed so far, it is suspended rather than failed:
+// feed() copies the next chunk in and resumes it exactly where it stopped,
+// so nothing is parsed twice. everything received lives in one region
+// reserved up front that never moves, so views taken before a suspension
+// (and the results that hold them) stay valid after it.
+//
+// feed() and finish() must be called from the same thread, and p must not
+// throw: an exception cannot leave the parse stack.
+//
+// after discardCommitted(), input the parse has cut past (see cutP) is
+// given back to the system a page at a time, so a long stream of records
+// runs in bounded memory. views into that input then read as zeros: only
+// results that do not point into it may outlive their cut.
+template<typename T>
+struct IncrementalParser : ParseSource {
+    explicit IncrementalParser(Parser<T> p, ParseContext ctx = ParseContext(),
+                               size_t capacity = size_t(1) << 30, size_t stackSize = size_t(8) << 20)
+        : p(std::move(p)), ctx(ctx), capacity(capacity), stackSize(stackSize) {
+        this->ctx.source = this;
+        buf = static_cast<char *>(reserve(capacity));
+        stack = reserve(stackSize);
+    }
+    IncrementalParser(const IncrementalParser &) = delete;
+    IncrementalParser &operator=(const IncrementalParser &) = delete;
+    ~IncrementalParser() {
+        // a suspended parse still owns objects on its stack; let it run to
+        // the end of the input so they are destroyed
+        if (started && !finished) finish();
+        munmap(stack, stackSize);
+        munmap(buf, capacity);
+    }
+    // appends chunk and runs the parse until it needs more input, which is
+    // reported as a failure with ERR_NEED_MORE, or until it is done. a
+    // chunk that does not fit in capacity ends the parse with ERR_CAPACITY.
+    ParseResult<T> &feed(std::string_view chunk) {
+        if (finished) return *result;
+        if (chunk.size() > capacity - size) {
+            finish();
+            result.emplace(ParseState(size, view(), &ctx), ParseError{size, ERR_CAPACITY, 0});
+            return *result;
+        }
+        std::memcpy(buf + size, chunk.data(), chunk.size());
+        size += chunk.size();
+        resume();
+        if (!finished) result.emplace(ParseState(size, view(), &ctx), ParseError{size, ERR_NEED_MORE, 0});
+        return *result;
+    }
+    // declares the end of the input; the parse now sees a real end of file
+    ParseResult<T> &finish() {
+        ended = true;
+        resume();
+        return *result;
+    }
+    bool done() const {
+        return finished;
+    }
+    void discardCommitted() {
+        discard = true;
+    }
+    std::string_view view() const {
+        return std::string_view(buf, size);
+    }
+    // runs on the parse stack, and switches back to the caller until a
+    // chunk arrives or the input ends
+    std::string_view more(std::string_view seen) override {
+        while (size == seen.size() && !ended) swapcontext(&fiber, &caller);
+        return view();
+    }
+    void release(unsigned long long pos) override {
+        static const size_t page = sysconf(_SC_PAGESIZE);
+        size_t end = std::min<unsigned long long>(pos, size) / page * page;
+        if (!discard || end <= discarded) return;
+        madvise(buf + discarded, end - discarded, MADV_DONTNEED);
+        discarded = end;
+    }
+private:
+    static void *reserve(size_t n) {
+        void *m = mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (m == MAP_FAILED) throw std::bad_alloc();
+        return m;
+    }
+    static IncrementalParser *&starting() {
+        static thread_local IncrementalParser *self = nullptr;
+        return self;
+    }
+    static void entry() {
+        IncrementalParser *self = starting();
+        self->result.emplace(self->p(ParseState(self->view(), &self->ctx)));
+        self->finished = true;
+        swapcontext(&self->fiber, &self->caller);
+    }
+    void resume() {
+        if (finished) return;
+        if (!started) {
+            started = true;
+            getcontext(&fiber);
+            fiber.uc_stack.ss_sp = stack;
+            fiber.uc_stack.ss_size = stackSize;
+            fiber.uc_link = nullptr;
+            makecontext(&fiber, &IncrementalParser::entry, 0);
+            starting() = this;
+        }
+        swapcontext(&caller, &fiber);
+    }
+    Parser<T> p;
+    ParseContext ctx;
+    char *buf;
+    size_t capacity, size = 0, discarded = 0;
+    void *stack;
+    size_t stackSize;
+    ucontext_t caller, fiber;
+    bool started = false, finished = false, ended = false, discard = false;
+    std::optional<ParseResult<T>> result;
+};
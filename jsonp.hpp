@@ -1,11 +1,133 @@
 #pragma once
 
 #include "cparsec.hpp"
+#include "sparsec.hpp"
+#include "profile.hpp"
 #include <string>
+#include <string_view>
 #include <list>
-#include <map>
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <unordered_map>
+#include <deque>
+#include <initializer_list>
+#include <type_traits>
 #include <utility>
-#include <variant>
+#include <cstring>
+
+struct JsonValue;
+
+// object keys interned for every document parsed with the pool in its
+// context, so a key repeated across millions of objects is stored once and
+// compared by address. the pool is bounded: past capacity distinct keys, or
+// for keys longer than maxLength, intern() declines and the key is copied
+// as usual. handles stay valid for the life of the pool, which any number
+// of parses may use, one at a time.
+struct KeyPool {
+    explicit KeyPool(size_t capacity = 1024, size_t maxLength = 64): capacity(capacity), maxLength(maxLength) {}
+    KeyPool(const KeyPool &) = delete;
+    KeyPool &operator=(const KeyPool &) = delete;
+    // the handle of key, added if there is room, or null
+    const std::string *intern(std::string_view key) {
+        auto i = index.find(key);
+        if (i != index.end()) return i->second;
+        if (keys.size() == capacity || key.size() > maxLength) return nullptr;
+        keys.emplace_back(key);
+        index.emplace(keys.back(), &keys.back());
+        return &keys.back();
+    }
+    // the handle of key if it has been interned, or null
+    const std::string *find(std::string_view key) const {
+        auto i = index.find(key);
+        return i == index.end() ? nullptr : i->second;
+    }
+    size_t size() const {
+        return keys.size();
+    }
+private:
+    size_t capacity, maxLength;
+    std::deque<std::string> keys;
+    std::unordered_map<std::string_view, const std::string *> index;
+};
+
+// an object key: a string of its own, or a handle into a KeyPool
+struct JsonKey {
+    JsonKey() {}
+    JsonKey(std::pmr::string s): own(std::move(s)) {}
+    JsonKey(const std::string &s): own(s) {}
+    JsonKey(const char *s): own(s) {}
+    explicit JsonKey(const std::string *pooled): pooled(pooled) {}
+    std::string_view view() const {
+        return pooled ? std::string_view(*pooled) : std::string_view(own);
+    }
+    operator std::string_view() const {
+        return view();
+    }
+    bool operator==(const JsonKey &k) const {
+        return (pooled && pooled == k.pooled) || view() == k.view();
+    }
+    // null for a key of its own
+    const std::string *pooled = nullptr;
+    std::pmr::string own;
+};
+
+// arrays, objects and strings are pmr containers, so a document parsed into
+// a JsonDocument lives entirely in its arena
+using JsonArray = std::pmr::vector<JsonValue>;
+using JsonMember = std::pair<JsonKey, JsonValue>;
+
+// key/value pairs in insertion order. lookups scan small objects and go
+// through a hash index, built on first lookup, once there are more than
+// indexThreshold keys. a repeated key resolves to its last occurrence.
+// members are only added through emplace(), which keeps the index in step;
+// a moved object builds its index afresh, since a move between resources
+// copies the keys the index points into.
+struct JsonObject {
+    static const size_t indexThreshold = 16;
+    JsonObject() {}
+    JsonObject(std::pmr::vector<JsonMember> items): items(std::move(items)) {}
+    JsonObject(std::initializer_list<JsonMember> items);
+    JsonObject(const JsonObject &o): items(o.items) {}
+    JsonObject(JsonObject &&o) noexcept: items(std::move(o.items)) {
+        o.index.reset();
+    }
+    JsonObject &operator=(const JsonObject &o) {
+        items = o.items;
+        index.reset();
+        return *this;
+    }
+    JsonObject &operator=(JsonObject &&o) {
+        items = std::move(o.items);
+        index.reset();
+        o.index.reset();
+        return *this;
+    }
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    auto begin() const { return items.begin(); }
+    auto end() const { return items.end(); }
+    const JsonMember &operator[](size_t i) const { return items[i]; }
+    std::pmr::polymorphic_allocator<JsonMember> get_allocator() const { return items.get_allocator(); }
+    void emplace(JsonKey key, JsonValue value);
+    const JsonValue *find(std::string_view key) const;
+    // by a handle from the KeyPool the object was parsed with: a pointer
+    // compare per member, except for members the pool had no room for
+    const JsonValue *find(const std::string *pooled) const;
+    bool operator==(const JsonObject &o) const;
+private:
+    using Index = std::pmr::unordered_map<std::string_view, size_t>;
+    // the index lives on the same memory resource as the items
+    struct IndexDeleter {
+        void operator()(Index *i) const {
+            std::pmr::memory_resource *m = i->get_allocator().resource();
+            i->~Index();
+            m->deallocate(i, sizeof(Index), alignof(Index));
+        }
+    };
+    std::pmr::vector<JsonMember> items;
+    mutable std::unique_ptr<Index, IndexDeleter> index;
+};
 
 struct JsonValue {
     enum JsonType {
@@ -17,48 +139,52 @@ struct JsonValue {
         JSON_OBJECT
     };
     JsonType type;
+    // strings keep short contents inline, so most keys and values do not
+    // allocate at all
     union {
         bool boolValue;
         double numValue;
-        std::string strValue;
-        std::list<JsonValue> arrayValue;
-        std::map<std::string, JsonValue> objectValue;
+        std::pmr::string strValue;
+        JsonArray arrayValue;
+        JsonObject objectValue;
     };
     JsonValue(): type(JSON_NULL) {}
     JsonValue(bool v): type(JSON_BOOL), boolValue(v) {}
     JsonValue(double v): type(JSON_NUM), numValue(v) {}
-    JsonValue(std::string v): type(JSON_STRING), strValue(v) {}
-    JsonValue(std::list<JsonValue> v): type(JSON_ARRAY), arrayValue(v) {}
-    JsonValue(std::map<std::string, JsonValue> v): type(JSON_OBJECT), objectValue(v) {}
-    JsonValue(const JsonValue &v): type(v.type) {
-        switch (v.type) {
-            case JSON_NULL: break;
-            case JSON_BOOL: boolValue = v.boolValue; break;
-            case JSON_NUM: numValue = v.numValue; break;
-            case JSON_STRING: new (&strValue) std::string(v.strValue); break;
-            case JSON_ARRAY: new (&arrayValue) std::list<JsonValue>(v.arrayValue); break;
-            case JSON_OBJECT: new (&objectValue) std::map<std::string, JsonValue>(v.objectValue); break;
-        }
+    JsonValue(std::pmr::string v): type(JSON_STRING), strValue(std::move(v)) {}
+    JsonValue(const std::string &v): type(JSON_STRING), strValue(v) {}
+    JsonValue(const char *v): type(JSON_STRING), strValue(v) {}
+    JsonValue(JsonArray v): type(JSON_ARRAY), arrayValue(std::move(v)) {}
+    JsonValue(JsonObject v): type(JSON_OBJECT), objectValue(std::move(v)) {}
+    JsonValue(const JsonValue &v): type(JSON_NULL) {
+        assign(v);
+    }
+    JsonValue(JsonValue &&v) noexcept: type(JSON_NULL) {
+        assign(std::move(v));
     }
     JsonValue &operator=(const JsonValue &v) {
-        type = v.type;
-        switch (v.type) {
-            case JSON_NULL: break;
-            case JSON_BOOL: boolValue = v.boolValue; break;
-            case JSON_NUM: numValue = v.numValue; break;
-            case JSON_STRING: new (&strValue) std::string(v.strValue); break;
-            case JSON_ARRAY: new (&arrayValue) std::list<JsonValue>(v.arrayValue); break;
-            case JSON_OBJECT: new (&objectValue) std::map<std::string, JsonValue>(v.objectValue); break;
+        if (this != &v) {
+            JsonValue t(v);
+            clear();
+            assign(std::move(t));
         }
         return *this;
     }
-    ~JsonValue() {
-        switch (type) {
-            case JSON_STRING: strValue.~basic_string(); break;
-            case JSON_ARRAY: arrayValue.~list(); break;
-            case JSON_OBJECT: objectValue.~map(); break;
-            default: break;
+    JsonValue &operator=(JsonValue &&v) noexcept {
+        if (this != &v) {
+            clear();
+            assign(std::move(v));
         }
+        return *this;
+    }
+    ~JsonValue() {
+        clear();
+    }
+    const JsonValue *find(std::string_view key) const {
+        return type == JSON_OBJECT ? objectValue.find(key) : nullptr;
+    }
+    const JsonValue *find(const std::string *pooled) const {
+        return type == JSON_OBJECT ? objectValue.find(pooled) : nullptr;
     }
     bool operator==(const JsonValue &v) const {
         if (type != v.type) return false;
@@ -72,29 +198,74 @@ struct JsonValue {
         }
         return false;
     }
+private:
+    void clear() {
+        switch (type) {
+            case JSON_STRING: strValue.~basic_string(); break;
+            case JSON_ARRAY: arrayValue.~JsonArray(); break;
+            case JSON_OBJECT: objectValue.~JsonObject(); break;
+            default: break;
+        }
+        type = JSON_NULL;
+    }
+    // expects this to be null
+    template<typename V>
+    void assign(V &&v) {
+        using A = std::conditional_t<std::is_lvalue_reference_v<V>, const JsonArray &, JsonArray &&>;
+        using O = std::conditional_t<std::is_lvalue_reference_v<V>, const JsonObject &, JsonObject &&>;
+        using S = std::conditional_t<std::is_lvalue_reference_v<V>, const std::pmr::string &, std::pmr::string &&>;
+        switch (v.type) {
+            case JSON_NULL: break;
+            case JSON_BOOL: boolValue = v.boolValue; break;
+            case JSON_NUM: numValue = v.numValue; break;
+            case JSON_STRING: new (&strValue) std::pmr::string(static_cast<S>(v.strValue)); break;
+            case JSON_ARRAY: new (&arrayValue) JsonArray(static_cast<A>(v.arrayValue)); break;
+            case JSON_OBJECT: new (&objectValue) JsonObject(static_cast<O>(v.objectValue)); break;
+        }
+        type = v.type;
+    }
 };
 
-std::ostream &operator<<(std::ostream &os, const JsonValue &js) {
-    switch (js.type) {
-        case JsonValue::JSON_NULL: os << "null"; break;
-        case JsonValue::JSON_BOOL: os << (js.boolValue ? "true" : "false"); break;
-        case JsonValue::JSON_NUM: os << js.numValue; break;
-        case JsonValue::JSON_STRING: os << js.strValue; break;
-        case JsonValue::JSON_ARRAY: {
-            os << "[";
-            for (const JsonValue &i : js.arrayValue) os << i << ", ";
-            os << "]";
-            break;
-        }
-        case JsonValue::JSON_OBJECT: {
-            os << "{";
-            for (const std::pair<std::string, JsonValue> &i : js.objectValue)
-                os << '"' << i.first << '"' << " : " << i.second << ", ";
-            os << "}";
-            break;
+JsonObject::JsonObject(std::initializer_list<JsonMember> items): items(items) {}
+
+void JsonObject::emplace(JsonKey key, JsonValue value) {
+    items.emplace_back(std::move(key), std::move(value));
+    index.reset();
+}
+
+const JsonValue *JsonObject::find(std::string_view key) const {
+    if (items.size() > indexThreshold) {
+        if (!index) {
+            std::pmr::memory_resource *m = items.get_allocator().resource();
+            index.reset(new (m->allocate(sizeof(Index), alignof(Index))) Index(items.size(), m));
+            for (size_t i = 0; i < items.size(); i++) (*index)[items[i].first.view()] = i;
         }
+        auto i = index->find(key);
+        return i == index->end() ? nullptr : &items[i->second].second;
     }
-    return os;
+    for (size_t i = items.size(); i-- > 0; )
+        if (items[i].first.view() == key) return &items[i].second;
+    return nullptr;
+}
+
+const JsonValue *JsonObject::find(const std::string *pooled) const {
+    for (size_t i = items.size(); i-- > 0; ) {
+        const JsonKey &k = items[i].first;
+        if (k.pooled == pooled || (!k.pooled && std::string_view(k.own) == *pooled)) return &items[i].second;
+    }
+    return nullptr;
+}
+
+bool JsonObject::operator==(const JsonObject &o) const {
+    if (items.size() != o.size()) return false;
+    for (const auto &i : items) {
+        const JsonValue *v = o.find(i.first);
+        if (!v || !(*v == *find(i.first))) return false;
+    }
+    // with repeated keys the sizes can match while the key sets differ
+    for (const auto &i : o)
+        if (!find(i.first)) return false;
+    return true;
 }
 
 Parser<JsonValue> nullP();
@@ -106,19 +277,18 @@ Parser<JsonValue> objectP();
 Parser<JsonValue> jsonP();
 
 Parser<JsonValue> nullP() {
-    return trimP(mapP<std::string, JsonValue>(stringP("null"), [] (std::string s) { return JsonValue(); }));
+    return trimP(mapP<std::string_view, JsonValue>(literalP("null"), [] (std::string_view) { return JsonValue(); }));
 }
 
 Parser<JsonValue> boolP() {
-    return trimP(orP(mapP<std::string, JsonValue>(stringP("true") , [] (std::string s) { return JsonValue(true) ; }),
-                     mapP<std::string, JsonValue>(stringP("false"), [] (std::string s) { return JsonValue(false); })));
+    return trimP(mapP<size_t, JsonValue>(keywordsP({"true", "false"}), [] (size_t i) { return JsonValue(i == 0); }));
 }
 
 Parser<JsonValue> numP() {
     return trimP(mapP<double, JsonValue>(doubleP, [] (double x) { return JsonValue(x); }));
 }
 
-Parser<char> escapeP = mapP<char, char>(idP, [] (char c) {
+char escapeChar(char c) {
     switch (c) {
         case '0': return '\0';
         case 'b': return '\b';
@@ -129,43 +299,500 @@ Parser<char> escapeP = mapP<char, char>(idP, [] (char c) {
         case 'r': return '\r';
     }
     return c;
-});
+}
+
+// the value of the four hex digits at p, or -1
+long hex4(const char *p) {
+    long x = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (d < 0) return -1;
+        x = x * 16 + d;
+    }
+    return x;
+}
+
+template<typename S>
+void appendUtf8(S &out, unsigned long cp) {
+    if (cp < 0x80) out.push_back((char) cp);
+    else if (cp < 0x800) {
+        out.push_back((char) (0xc0 | cp >> 6));
+        out.push_back((char) (0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+        out.push_back((char) (0xe0 | cp >> 12));
+        out.push_back((char) (0x80 | (cp >> 6 & 0x3f)));
+        out.push_back((char) (0x80 | (cp & 0x3f)));
+    } else {
+        out.push_back((char) (0xf0 | cp >> 18));
+        out.push_back((char) (0x80 | (cp >> 12 & 0x3f)));
+        out.push_back((char) (0x80 | (cp >> 6 & 0x3f)));
+        out.push_back((char) (0x80 | (cp & 0x3f)));
+    }
+}
+
+// appends the contents of a string literal, taken without its quotes and
+// already checked by stringBody, with its escapes decoded. \uXXXX becomes
+// UTF-8, a surrogate pair one four-byte sequence. the result is never
+// longer than raw.
+template<typename S>
+void unescapeTo(std::string_view raw, S &out) {
+    size_t i = 0;
+    while (i < raw.size()) {
+        size_t j = std::min(raw.find('\\', i), raw.size());
+        out.append(raw.data() + i, j - i);
+        if (j + 1 >= raw.size()) break;
+        if (raw[j + 1] != 'u') {
+            out.push_back(escapeChar(raw[j + 1]));
+            i = j + 2;
+            continue;
+        }
+        unsigned long cp = hex4(raw.data() + j + 2);
+        i = j + 6;
+        if (cp >= 0xd800 && cp < 0xdc00) {
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (hex4(raw.data() + j + 8) - 0xdc00);
+            i = j + 12;
+        }
+        appendUtf8(out, cp);
+    }
+}
+
+const Parser<char> escapeP = mapP<char, char>(idP, escapeChar);
+
+// the bytes of a string literal that need no attention, for scans that only
+// look for where the literal ends
+const ClassScanner stringScanner(~CharClass("\"\\"));
+
+// the bytes a valid literal may hold as they are: no quote, no backslash
+// and no control character
+const ClassScanner literalScanner(~(CharClass("\"\\") | CharClass::range(0, 0x1f)));
 
-Parser<std::string> escapeStrP = trimP(betweenP(charP('"'), charP('"'),
-    mapP<std::list<char>, std::string>(manyP(orP(rightP(charP('\\'), escapeP), predP([] (char c) { return c != '"'; }))), 
-    [] (std::list<char> cs) {
-        std::string s = "";
-        for (char x : cs) s.push_back(x);
-        return s;
-    })));
+// the body of a string literal, from t just past its opening quote up to
+// its closing quote, where t is left. runs of plain bytes are found a
+// vector block at a time and checked to be UTF-8; escapes are checked, not
+// decoded, and escaped tells whether there were any. as RFC 8259 has it,
+// control characters must be escaped and only \" \\ \/ \b \f \n \r \t and
+// \u with four hex digits are escapes; anything else after a backslash is
+// ERR_ESCAPE at the backslash.
+ParseResult<bool> stringBody(ParseState &t, bool &escaped) {
+    escaped = false;
+    while (true) {
+        size_t n = spanAt(literalScanner, t);
+        size_t bad = utf8Invalid(t.s.data() + t.pos, n);
+        if (bad < n) return failure<bool>(t.advance(bad), ERR_UNEXPECT, t.s[t.pos + bad]);
+        t.pos += n;
+        if (atEnd(t)) return failure<bool>(t, ERR_EOF);
+        char c = t.s[t.pos];
+        if (c == '"') return success(t, true);
+        if (c != '\\') return failure<bool>(t, ERR_UNEXPECT, c);
+        if (!ensure(t, 2)) return failure<bool>(t.advance(1), ERR_EOF);
+        escaped = true;
+        char e = t.s[t.pos + 1];
+        if (e != 'u') {
+            if (!std::strchr("\"\\/bfnrt", e) || e == 0) return failure<bool>(t, ERR_ESCAPE, e);
+            t.pos += 2;
+            continue;
+        }
+        // a high surrogate only counts as part of a pair, a low one never
+        // stands alone
+        if (!ensure(t, 6)) return failure<bool>(ParseState(t.s.size(), t.s, t.ctx), ERR_EOF);
+        long cp = hex4(t.s.data() + t.pos + 2);
+        if (cp < 0) return failure<bool>(t, ERR_ESCAPE, 'u');
+        if (cp >= 0xdc00 && cp < 0xe000) return failure<bool>(t, ERR_UNEXPECT, '\\');
+        if (cp >= 0xd800 && cp < 0xdc00) {
+            for (size_t k = 6; k < 8; k++) {
+                if (!ensure(t, k + 1)) return failure<bool>(ParseState(t.s.size(), t.s, t.ctx), ERR_EOF);
+                if (t.s[t.pos + k] != "\\u"[k - 6]) return failure<bool>(t, ERR_UNEXPECT, '\\');
+            }
+            if (!ensure(t, 12)) return failure<bool>(ParseState(t.s.size(), t.s, t.ctx), ERR_EOF);
+            long lo = hex4(t.s.data() + t.pos + 8);
+            if (lo < 0) return failure<bool>(t.advance(6), ERR_ESCAPE, 'u');
+            if (lo < 0xdc00 || lo >= 0xe000) return failure<bool>(t, ERR_UNEXPECT, '\\');
+            t.pos += 6;
+        }
+        t.pos += 6;
+    }
+}
+
+// the raw contents of a string literal and whether they need unescapeTo
+struct RawString {
+    std::string_view raw;
+    bool escaped;
+};
+
+// a string literal after whitespace, up to the whitespace after it
+ParseResult<RawString> rawStringAt(ParseState s) {
+    s = skipSpace(s);
+    if (atEnd(s) || s.s[s.pos] != '"') return failure<RawString>(s, ERR_EXPECT_CHAR, '"');
+    ParseState t = s.advance(1);
+    bool escaped;
+    ParseResult<bool> r = stringBody(t, escaped);
+    if (!r.success) return ParseResult<RawString>(r.state, r.error);
+    RawString str{t.s.substr(s.pos + 1, t.pos - s.pos - 1), escaped};
+    return success(skipSpace(t.advance(1)), str);
+}
+
+// a string literal decoded into S, built on the memory resource of the
+// parse when it is a pmr string
+template<typename S>
+Parser<S> decodedStrP() {
+    Parser<S> p = [] (ParseState s) {
+        ParseResult<RawString> r = rawStringAt(s);
+        if (!r.success) return ParseResult<S>(r.state, r.error);
+        S str = newIn<S>(s);
+        if (s.skipping()) return success(r.state, std::move(str));
+        if (r.result.escaped) unescapeTo(r.result.raw, str);
+        else str.assign(r.result.raw.data(), r.result.raw.size());
+        return success(r.state, std::move(str));
+    };
+    p.first.known = true;
+    p.first.trim = true;
+    p.first.bytes.set('"');
+    return p;
+}
+
+const Parser<std::string> escapeStrP = decodedStrP<std::string>();
+
+// a string literal decoded straight into the memory resource of the parse
+Parser<std::pmr::string> jsonStrP() {
+    return decodedStrP<std::pmr::string>();
+}
+
+// a string literal as a view: of the input itself when it has no escapes,
+// otherwise of a decoded copy on the memory resource of the parse, which
+// is only reclaimed with that resource (so give the parse an arena)
+Parser<std::string_view> jsonStrViewP() {
+    struct Out {
+        char *p;
+        size_t n;
+        void append(const char *s, size_t k) {
+            std::memcpy(p + n, s, k);
+            n += k;
+        }
+        void push_back(char c) {
+            p[n++] = c;
+        }
+    };
+    Parser<std::string_view> p = [] (ParseState s) {
+        ParseResult<RawString> r = rawStringAt(s);
+        if (!r.success) return ParseResult<std::string_view>(r.state, r.error);
+        std::string_view raw = r.result.raw;
+        if (!r.result.escaped || s.skipping()) return success(r.state, raw);
+        Out out{static_cast<char *>(s.memory()->allocate(raw.size(), 1)), 0};
+        unescapeTo(raw, out);
+        return success(r.state, std::string_view(out.p, out.n));
+    };
+    p.first.known = true;
+    p.first.trim = true;
+    p.first.bytes.set('"');
+    return p;
+}
+
+// the key for the contents of a string literal: a handle when the parse
+// has a KeyPool with room for it, else a copy decoded on its memory
+JsonKey keyOf(ParseState s, const RawString &r) {
+    std::pmr::string own(s.memory());
+    if (r.escaped) unescapeTo(r.raw, own);
+    KeyPool *keys = s.ctx ? s.ctx->keys : nullptr;
+    if (const std::string *pooled = keys ? keys->intern(r.escaped ? std::string_view(own) : r.raw) : nullptr)
+        return JsonKey(pooled);
+    if (!r.escaped) own = r.raw;
+    return JsonKey(std::move(own));
+}
+
+Parser<JsonKey> jsonKeyP() {
+    Parser<JsonKey> p = [] (ParseState s) {
+        ParseResult<RawString> r = rawStringAt(s);
+        if (!r.success) return ParseResult<JsonKey>(r.state, r.error);
+        if (s.skipping()) return success(r.state, JsonKey());
+        return success(r.state, keyOf(s, r.result));
+    };
+    p.first = jsonStrP().first;
+    return p;
+}
 
 Parser<JsonValue> strP() {
-    return mapP<std::string, JsonValue>(escapeStrP, [] (std::string s) { return JsonValue(s); });
+    return mapP<std::pmr::string, JsonValue>(jsonStrP(), [] (std::pmr::string s) { return JsonValue(std::move(s)); });
+}
+
+// steps over one value by counting brackets and quotes, without checking
+// the grammar in between: a cheap way past subtrees that will not be read.
+// yields the raw text of the value. a scalar runs up to the next delimiter.
+Parser<std::string_view> skipValueP() {
+    static const ClassScanner plain(~CharClass("\"[]{}"));
+    static const ClassScanner scalar(~(spaceClass | CharClass(",:[]{}\"")));
+    Parser<std::string_view> p = [] (ParseState s) {
+        s = skipSpace(s);
+        if (atEnd(s)) return failure<std::string_view>(s, ERR_EOF);
+        char c0 = s.s[s.pos];
+        ParseState t = s;
+        if (c0 != '"' && c0 != '[' && c0 != '{') {
+            size_t n = spanAt(scalar, t);
+            if (n == 0) return failure<std::string_view>(s, ERR_UNEXPECT, c0);
+            t.pos += n;
+            return success(skipSpace(t), t.s.substr(s.pos, n));
+        }
+        size_t depth = 0;
+        do {
+            t.pos += spanAt(plain, t);
+            if (atEnd(t)) return failure<std::string_view>(t, ERR_EOF);
+            char c = t.s[t.pos++];
+            if (c == '"') {
+                while (true) {
+                    t.pos += spanAt(stringScanner, t);
+                    if (atEnd(t)) return failure<std::string_view>(t, ERR_EOF);
+                    if (t.s[t.pos] == '"') break;
+                    if (!ensure(t, 2)) return failure<std::string_view>(t.advance(1), ERR_EOF);
+                    t.pos += 2;
+                }
+                t.pos++;
+            } else if (c == '[' || c == '{') depth++;
+            else depth--;
+        } while (depth);
+        std::string_view raw = t.s.substr(s.pos, t.pos - s.pos);
+        return success(skipSpace(t), raw);
+    };
+    p.first.known = true;
+    p.first.trim = true;
+    p.first.bytes = ~(spaceClass | CharClass(",:]}"));
+    return p;
+}
+
+// the grammar of JSON over values of type V. A says what each piece
+// yields: the scalars, the brackets (run as they are met, so a SAX grammar
+// can report them), the keys, and how the elements collected into its Items
+// and Members become a V. the tree and the SAX grammars are both this one.
+template<typename V, typename A>
+struct JsonRules {
+    Rule<V> value, array, object;
+    JsonRules() {
+        using Items = typename A::Items;
+        using Member = typename A::Member;
+        using Members = typename A::Members;
+        Parser<V> itemsP = mapP<Items, V>(sepByP<V, char, Items>(ruleP(value), charP(',')), A::array);
+        array = namedP("array", trimP(betweenP(A::openArray(), trimP(A::closeArray()), itemsP)));
+        Parser<Member> memberP = andP<typename A::Key, V, Member>(A::keyP(), rightP(charP(':'), ruleP(value)), A::member);
+        Parser<V> membersP = mapP<Members, V>(sepByP<Member, char, Members>(memberP, charP(',')), A::object);
+        object = namedP("object", trimP(betweenP(A::openObject(), trimP(A::closeObject()), membersP)));
+        value = namedP("value", orP(A::nullP(), A::boolP(), A::numP(), A::strP(), ruleP(array), ruleP(object)));
+    }
+};
+
+// what JsonRules builds for jsonP(): a JsonValue tree
+struct JsonTree {
+    using Items = JsonArray;
+    using Key = JsonKey;
+    using Member = JsonMember;
+    using Members = std::pmr::vector<JsonMember>;
+    static Parser<JsonValue> nullP() { return ::nullP(); }
+    static Parser<JsonValue> boolP() { return ::boolP(); }
+    static Parser<JsonValue> numP() { return ::numP(); }
+    static Parser<JsonValue> strP() { return ::strP(); }
+    static Parser<JsonKey> keyP() { return jsonKeyP(); }
+    static Parser<char> openArray() { return charP('['); }
+    static Parser<char> closeArray() { return charP(']'); }
+    static Parser<char> openObject() { return charP('{'); }
+    static Parser<char> closeObject() { return charP('}'); }
+    static JsonValue array(JsonArray xs) {
+        return JsonValue(std::move(xs));
+    }
+    static JsonMember member(JsonKey k, JsonValue v) {
+        return JsonMember(std::move(k), std::move(v));
+    }
+    static JsonValue object(Members xs) {
+        return JsonValue(JsonObject(std::move(xs)));
+    }
+};
+
+// built once on first use; jsonP(), arrayP() and objectP() hand out
+// references to these rules instead of rebuilding the grammar
+using JsonGrammar = JsonRules<JsonValue, JsonTree>;
+
+const JsonGrammar &jsonGrammar() {
+    static const JsonGrammar g;
+    return g;
 }
 
 Parser<JsonValue> arrayP() {
-    Parser<JsonValue> p = orP(andP<JsonValue, std::list<JsonValue>, JsonValue>(lazyP<JsonValue>(jsonP), 
-        manyP(rightP(charP(','), lazyP<JsonValue>(jsonP))), [] (JsonValue x, std::list<JsonValue> xs) {
-            xs.push_front(x);
-            return JsonValue(xs);
-        }), pureP(JsonValue(std::list<JsonValue>())));
-    return trimP(betweenP(charP('['), charP(']'), p));
+    return ruleP(jsonGrammar().array);
 }
 
 Parser<JsonValue> objectP() {
-    using kv = std::pair<std::string, JsonValue>;
-    Parser<kv> itemP = andP<std::string, JsonValue, kv>
-        (escapeStrP, rightP(charP(':'), lazyP<JsonValue>(jsonP)), std::make_pair<std::string, JsonValue>);
-    Parser<JsonValue> p = orP(andP<kv, std::list<kv>, JsonValue>(itemP, 
-        manyP(rightP(charP(','), itemP)), [] (kv x, std::list<kv> xs) {
-            xs.push_front(x);
-            std::map<std::string, JsonValue> m = std::map<std::string, JsonValue>();
-            for (kv i : xs) m[i.first] = i.second;
-            return JsonValue(m);
-        }), pureP(JsonValue(std::map<std::string, JsonValue>())));
-    return trimP(betweenP(charP('{'), charP('}'), p));
+    return ruleP(jsonGrammar().object);
+}
+
+Parser<JsonValue> jsonP() {
+    return ruleP(jsonGrammar().value);
+}
+
+// jsonP() without the recursion: the containers being filled are kept on a
+// heap stack, so the native stack used is the same however deep the input
+// nests, and nesting past maxDepth fails with ERR_DEPTH, which is fatal.
+// it accepts what jsonP() accepts, but a failure points at the innermost
+// offending byte, as JsonTape's do, rather than at the element of the
+// outermost container that holds it. the tree it builds is still destroyed
+// recursively, so maxDepth should stay within what the stack can unwind.
+Parser<JsonValue> jsonStackP(size_t maxDepth = 1024) {
+    Parser<JsonValue> p = [=] (ParseState s) {
+        static const Parser<JsonValue> scalarP = orP(nullP(), boolP(), numP(), strP());
+        static const Parser<JsonKey> keyP = jsonKeyP();
+        struct Frame {
+            bool object;
+            JsonValue value;
+            JsonKey key;
+        };
+        bool keep = !s.skipping();
+        std::vector<Frame> stack;
+        enum { VALUE, FIRST_VALUE, KEY, FIRST_KEY, AFTER } state = VALUE;
+        // a finished value goes into the innermost container
+        auto add = [&] (JsonValue v) {
+            Frame &f = stack.back();
+            if (keep && f.object) f.value.objectValue.emplace(std::move(f.key), std::move(v));
+            else if (keep) f.value.arrayValue.push_back(std::move(v));
+        };
+        ParseState t = skipSpace(s);
+        while (true) {
+            if (state == VALUE || state == FIRST_VALUE) {
+                if (atEnd(t)) return failure<JsonValue>(t, ERR_EOF);
+                char c = t.s[t.pos];
+                if (c == '[' || c == '{') {
+                    if (stack.size() == maxDepth) return failure<JsonValue>(t, ERR_DEPTH);
+                    bool object = c == '{';
+                    stack.push_back(Frame{object, JsonValue(), JsonKey()});
+                    if (keep && object) stack.back().value = JsonValue(JsonObject(newIn<std::pmr::vector<JsonMember>>(t)));
+                    else if (keep) stack.back().value = JsonValue(newIn<JsonArray>(t));
+                    t = skipSpace(t.advance(1));
+                    state = object ? FIRST_KEY : FIRST_VALUE;
+                    continue;
+                }
+                if (state == VALUE || c != ']') {
+                    ParseResult<JsonValue> r = scalarP(t);
+                    if (!r.success) return r;
+                    t = r.state;
+                    if (stack.empty()) return r;
+                    add(std::move(r.result));
+                    state = AFTER;
+                    continue;
+                }
+            } else if (state == KEY || state == FIRST_KEY) {
+                if (state == KEY || atEnd(t) || t.s[t.pos] != '}') {
+                    ParseResult<JsonKey> k = keyP(t);
+                    if (!k.success) return ParseResult<JsonValue>(k.state, k.error);
+                    t = k.state;
+                    if (atEnd(t) || t.s[t.pos] != ':') return failure<JsonValue>(t, ERR_EXPECT_CHAR, ':');
+                    if (keep) stack.back().key = std::move(k.result);
+                    t = skipSpace(t.advance(1));
+                    state = VALUE;
+                    continue;
+                }
+            } else {
+                char close = stack.back().object ? '}' : ']';
+                if (!atEnd(t) && t.s[t.pos] == ',') {
+                    t = skipSpace(t.advance(1));
+                    state = stack.back().object ? KEY : VALUE;
+                    continue;
+                }
+                if (atEnd(t) || t.s[t.pos] != close) return failure<JsonValue>(t, ERR_EXPECT_CHAR, close);
+            }
+            // t is at the bracket that closes the innermost container
+            t = skipSpace(t.advance(1));
+            JsonValue v = std::move(stack.back().value);
+            stack.pop_back();
+            if (stack.empty()) return success(t, std::move(v));
+            add(std::move(v));
+            state = AFTER;
+        }
+    };
+    p.first = jsonP().first;
+    return p;
+}
+
+namespace sp {
+
+// the same grammar as ::jsonP() in the static engine, erased only where
+// arrays and objects recurse back into a value
+const Parser<JsonValue> &jsonGrammar() {
+    static Parser<JsonValue> value;
+    static const bool built = [] {
+        auto nullP = trimP(mapP(literalP("null"), [] (std::string_view) { return JsonValue(); }));
+        auto boolP = trimP(orP(mapP(literalP("true") , [] (std::string_view) { return JsonValue(true) ; }),
+                               mapP(literalP("false"), [] (std::string_view) { return JsonValue(false); })));
+        auto numP = trimP(mapP(::doubleP, [] (double x) { return JsonValue(x); }));
+        // strings are one erased call to the block-scanning parser, not a
+        // combinator step per character
+        const Parser<std::string> &escapeStrP = ::escapeStrP;
+        auto strP = mapP(escapeStrP, [] (std::string s) { return JsonValue(s); });
+        auto arrayP = trimP(betweenP(charP('['), trimP(charP(']')), orP(
+            andP(lazyP(value), manyP(rightP(charP(','), lazyP(value))), [] (JsonValue x, std::list<JsonValue> xs) {
+                JsonArray a;
+                a.reserve(xs.size() + 1);
+                a.push_back(std::move(x));
+                for (JsonValue &i : xs) a.push_back(std::move(i));
+                return JsonValue(std::move(a));
+            }), sp::pureP(JsonValue(JsonArray())))));
+        using kv = JsonMember;
+        auto itemP = andP(escapeStrP, rightP(charP(':'), lazyP(value)), [] (std::string k, JsonValue v) {
+            return kv(std::pmr::string(k), std::move(v));
+        });
+        auto objectP = trimP(betweenP(charP('{'), trimP(charP('}')), orP(
+            andP(itemP, manyP(rightP(charP(','), itemP)), [] (kv x, std::list<kv> xs) {
+                std::pmr::vector<kv> items;
+                items.reserve(xs.size() + 1);
+                items.push_back(std::move(x));
+                for (kv &i : xs) items.push_back(std::move(i));
+                return JsonValue(JsonObject(std::move(items)));
+            }), sp::pureP(JsonValue(JsonObject())))));
+        value = erase(orP(nullP, boolP, numP, strP, arrayP, objectP));
+        return true;
+    }();
+    (void) built;
+    return value;
 }
 
 Parser<JsonValue> jsonP() {
-    return orP(nullP(), boolP(), numP(), strP(), lazyP<JsonValue>(arrayP), lazyP<JsonValue>(objectP));
+    return lazyP(jsonGrammar());
+}
+
 }
+
+// owns a monotonic arena that every string, array and object of the parsed
+// tree is allocated in. the tree is never destroyed node by node: dropping
+// or reparsing the document releases the whole arena at once.
+struct JsonDocument {
+    explicit JsonDocument(size_t initialSize = 1 << 16): arena(initialSize) {}
+    JsonDocument(const JsonDocument &) = delete;
+    JsonDocument &operator=(const JsonDocument &) = delete;
+    ~JsonDocument() {
+        release();
+    }
+    bool parse(std::string_view s) {
+        release();
+        ctx.memory = &arena;
+        static const Parser<JsonValue> documentP = leftP(jsonP(), eofP);
+        ParseResult<JsonValue> r = documentP(ParseState(s, &ctx));
+        if (!r.success) {
+            error = r.error;
+            return false;
+        }
+        new (storage) JsonValue(std::move(r.result));
+        ok = true;
+        return true;
+    }
+    const JsonValue &root() const {
+        static const JsonValue none;
+        return ok ? *std::launder(reinterpret_cast<const JsonValue *>(storage)) : none;
+    }
+    std::pmr::memory_resource *memory() {
+        return &arena;
+    }
+    ParseError error{};
+private:
+    void release() {
+        ok = false;
+        arena.release();
+    }
+    std::pmr::monotonic_buffer_resource arena;
+    ParseContext ctx;
+    alignas(JsonValue) unsigned char storage[sizeof(JsonValue)];
+    bool ok = false;
+};
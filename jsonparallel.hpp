@@ -0,0 +1,159 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include "jsonp.hpp"
+#include "records.hpp"
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <new>
+#include <memory>
+#include <optional>
+#include <memory_resource>
+
+// a memory resource shared by several threads, one call at a time
+struct LockedResource : std::pmr::memory_resource {
+    explicit LockedResource(std::pmr::memory_resource *upstream): upstream(upstream) {}
+private:
+    void *do_allocate(size_t n, size_t align) override {
+        std::lock_guard<std::mutex> l(m);
+        return upstream->allocate(n, align);
+    }
+    void do_deallocate(void *p, size_t n, size_t align) override {
+        std::lock_guard<std::mutex> l(m);
+        upstream->deallocate(p, n, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &o) const noexcept override {
+        return this == &o;
+    }
+    std::pmr::memory_resource *upstream;
+    std::mutex m;
+};
+
+// a deep copy of v whose strings, arrays and objects all allocate from m
+JsonValue copyIn(const JsonValue &v, std::pmr::memory_resource *m) {
+    switch (v.type) {
+        case JsonValue::JSON_STRING: return JsonValue(std::pmr::string(v.strValue, m));
+        case JsonValue::JSON_ARRAY: {
+            JsonArray xs(m);
+            xs.reserve(v.arrayValue.size());
+            for (const JsonValue &x : v.arrayValue) xs.push_back(copyIn(x, m));
+            return JsonValue(std::move(xs));
+        }
+        case JsonValue::JSON_OBJECT: {
+            std::pmr::vector<JsonMember> items(m);
+            items.reserve(v.objectValue.size());
+            for (const JsonMember &i : v.objectValue) {
+                JsonKey k = i.first.pooled ? JsonKey(i.first.pooled) : JsonKey(std::pmr::string(i.first.own, m));
+                items.emplace_back(std::move(k), copyIn(i.second, m));
+            }
+            return JsonValue(JsonObject(std::move(items)));
+        }
+        default: return v;
+    }
+}
+
+// the top-level elements of the array whose '[' is at open, as [begin, end)
+// offsets up to the ',' or ']' that ends each, found without parsing them.
+// false if the brackets or quotes never balance; close is the final ']'.
+bool arrayElements(std::string_view in, size_t open, std::vector<std::pair<size_t, size_t>> &elems, size_t &close) {
+    static const ClassScanner plain(~CharClass("\"[]{},"));
+    size_t i = open + 1, b = i, depth = 0;
+    while (true) {
+        i += plain.span(in.data() + i, in.size() - i);
+        if (i == in.size()) return false;
+        char c = in[i];
+        if (c == '"') {
+            i++;
+            while (true) {
+                i += stringScanner.span(in.data() + i, in.size() - i);
+                if (i >= in.size()) return false;
+                if (in[i] == '"') break;
+                if (i + 1 >= in.size()) return false;
+                i += 2;
+            }
+        } else if (c == '[' || c == '{') depth++;
+        else if (depth && (c == ']' || c == '}')) depth--;
+        else if (c == ',' && !depth) {
+            elems.push_back(std::make_pair(b, i));
+            b = i + 1;
+        } else if (c == ']') {
+            if (!elems.empty() || skipSpace(ParseState(b, in)).pos != i) elems.push_back(std::make_pair(b, i));
+            close = i;
+            return true;
+        } else if (c != ',') return false;
+        i++;
+    }
+}
+
+// arrayP() for one huge array: a structural pre-scan finds where its
+// top-level elements begin and end, groups of elements are parsed on the
+// pool, and the values are moved into one array in order. arrays shorter
+// than minBytes, growing input, traced parses and any failure (for its
+// exact error) go to arrayP() instead.
+//
+// when the parse has a memory resource, each worker parses into an arena
+// of its own on top of it. when that resource is itself an arena, which
+// frees nothing until it is released, the workers' arenas are carved out
+// of it and the values stay where they were built. any other resource
+// gets the values copied into it, and the workers' arenas back, before
+// the call returns.
+Parser<JsonValue> parallelArrayP(WorkPool &pool = defaultPool(), size_t minBytes = 1 << 20) {
+    Parser<JsonValue> p = [&pool, minBytes] (ParseState s) {
+        Parser<JsonValue> sequential = arrayP();
+        ParseState at = skipSpace(s);
+        if (at.s.size() - at.pos < minBytes || (s.ctx && (s.ctx->source || s.ctx->trace || s.ctx->skip)))
+            return sequential(s);
+        if (at.pos == at.s.size() || at.s[at.pos] != '[') return sequential(s);
+        std::vector<std::pair<size_t, size_t>> elems;
+        size_t close;
+        if (!arrayElements(at.s, at.pos, elems, close)) return sequential(s);
+        if (elems.empty() || close + 1 - at.pos < minBytes) return sequential(s);
+        std::vector<ParseContext> ctxs(pool.size(), s.ctx ? *s.ctx : ParseContext());
+        // memo tables, key pools and profiles serve one parse at a time;
+        // elements parsed here keep keys of their own and are not profiled
+        for (ParseContext &c : ctxs) {
+            c.memo = nullptr;
+            c.keys = nullptr;
+            c.profile = nullptr;
+        }
+        using Arena = std::pmr::monotonic_buffer_resource;
+        std::pmr::memory_resource *m = s.ctx ? s.ctx->memory : nullptr;
+        bool copy = m && !dynamic_cast<Arena *>(m);
+        std::optional<LockedResource> shared;
+        std::vector<std::unique_ptr<Arena>> arenas;
+        if (m && !copy) {
+            LockedResource *locked = new (m->allocate(sizeof(LockedResource), alignof(LockedResource))) LockedResource(m);
+            for (ParseContext &c : ctxs) c.memory = new (m->allocate(sizeof(Arena), alignof(Arena))) Arena(locked);
+        } else if (copy) {
+            shared.emplace(m);
+            for (ParseContext &c : ctxs) {
+                arenas.push_back(std::make_unique<Arena>(&*shared));
+                c.memory = arenas.back().get();
+            }
+        }
+        std::vector<JsonValue> values(elems.size());
+        std::vector<char> ok(elems.size(), 0);
+        size_t groups = std::min(elems.size(), pool.size() * 8);
+        const Parser<JsonValue> &valueP = jsonP();
+        pool.run(groups, [&] (size_t w, size_t g) {
+            for (size_t i = elems.size() * g / groups; i < elems.size() * (g + 1) / groups; i++) {
+                ParseResult<JsonValue> r = valueP(ParseState(elems[i].first, at.s.substr(0, elems[i].second), &ctxs[w]));
+                if (!r.success || r.state.pos != elems[i].second) return;
+                values[i] = std::move(r.result);
+                ok[i] = 1;
+            }
+        });
+        for (char o : ok)
+            if (!o) return sequential(s);
+        JsonArray xs = newIn<JsonArray>(s);
+        xs.reserve(values.size());
+        for (JsonValue &v : values) xs.push_back(copy ? copyIn(v, m) : std::move(v));
+        return success(skipSpace(ParseState(close + 1, at.s, s.ctx)), JsonValue(std::move(xs)));
+    };
+    p.first.known = true;
+    p.first.trim = true;
+    p.first.bytes.set('[');
+    return p;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include "jsonp.hpp"
+#include <string>
+#include <string_view>
+#include <functional>
+
+// receives a document as a stream of events instead of a tree. returning
+// false from any of them stops the parse, which then fails with ERR_ABORT
+// at the offset just past the value that raised the event.
+struct JsonHandler {
+    virtual ~JsonHandler() {}
+    virtual bool onNull() { return true; }
+    virtual bool onBool(bool) { return true; }
+    virtual bool onNumber(double) { return true; }
+    // views are only valid for the duration of the call
+    virtual bool onString(std::string_view) { return true; }
+    virtual bool onKey(std::string_view) { return true; }
+    virtual bool onStartArray() { return true; }
+    virtual bool onEndArray() { return true; }
+    virtual bool onStartObject() { return true; }
+    virtual bool onEndObject() { return true; }
+};
+
+// null when the grammar runs without one, as it does under explain()
+JsonHandler *handlerOf(ParseState s) {
+    return s.ctx ? static_cast<JsonHandler *>(s.ctx->user) : nullptr;
+}
+
+// runs p and hands its result to the handler of this parse
+template<typename A>
+Parser<bool> eventP(Parser<A> p, std::function<bool(JsonHandler &, A)> f) {
+    Parser<bool> q = [=] (ParseState s) {
+        ParseResult<A> r = p(s);
+        if (!r.success) return ParseResult<bool>(r.state, r.error);
+        JsonHandler *h = handlerOf(r.state);
+        if (h && !f(*h, std::move(r.result))) return failure<bool>(r.state, ERR_ABORT);
+        return success(r.state, true);
+    };
+    q.first = p.first;
+    return q;
+}
+
+// a string literal passed on as a view of the input, decoded into a scratch
+// buffer only when it has escapes
+Parser<bool> saxStrP(bool key) {
+    Parser<bool> p = [=] (ParseState s) {
+        ParseResult<RawString> r = rawStringAt(s);
+        if (!r.success) return ParseResult<bool>(r.state, r.error);
+        std::string_view raw = r.result.raw;
+        std::string decoded;
+        if (r.result.escaped) {
+            unescapeTo(raw, decoded);
+            raw = decoded;
+        }
+        JsonHandler *h = handlerOf(s);
+        ParseState t = r.state;
+        if (h && !(key ? h->onKey(raw) : h->onString(raw))) return failure<bool>(t, ERR_ABORT);
+        return success(t, true);
+    };
+    p.first.known = true;
+    p.first.trim = true;
+    p.first.bytes.set('"');
+    return p;
+}
+
+// what JsonRules builds for parseSax(): every value is reported to the
+// handler as it is recognised, and nothing is kept
+struct JsonEvents {
+    // what sepByP collects elements into
+    struct Discard {
+        void push_back(bool) {}
+    };
+    using Items = Discard;
+    using Key = bool;
+    using Member = bool;
+    using Members = Discard;
+    static Parser<bool> nullP() {
+        return trimP(eventP<std::string_view>(literalP("null"), [] (JsonHandler &h, std::string_view) { return h.onNull(); }));
+    }
+    static Parser<bool> boolP() {
+        return trimP(eventP<size_t>(keywordsP({"true", "false"}), [] (JsonHandler &h, size_t i) { return h.onBool(i == 0); }));
+    }
+    static Parser<bool> numP() {
+        return trimP(eventP<double>(doubleP, [] (JsonHandler &h, double x) { return h.onNumber(x); }));
+    }
+    static Parser<bool> strP() { return saxStrP(false); }
+    static Parser<bool> keyP() { return saxStrP(true); }
+    static Parser<bool> openArray() {
+        return eventP<char>(charP('['), [] (JsonHandler &h, char) { return h.onStartArray(); });
+    }
+    static Parser<bool> closeArray() {
+        return eventP<char>(charP(']'), [] (JsonHandler &h, char) { return h.onEndArray(); });
+    }
+    static Parser<bool> openObject() {
+        return eventP<char>(charP('{'), [] (JsonHandler &h, char) { return h.onStartObject(); });
+    }
+    static Parser<bool> closeObject() {
+        return eventP<char>(charP('}'), [] (JsonHandler &h, char) { return h.onEndObject(); });
+    }
+    static bool array(Discard) { return true; }
+    static bool member(bool, bool) { return true; }
+    static bool object(Discard) { return true; }
+};
+
+using JsonSaxGrammar = JsonRules<bool, JsonEvents>;
+
+const JsonSaxGrammar &jsonSaxGrammar() {
+    static const JsonSaxGrammar g;
+    return g;
+}
+
+// parses s as one JSON document, reporting it to h without building a tree
+ParseResult<bool> parseSax(std::string_view s, JsonHandler &h) {
+    static const Parser<bool> documentP = leftP(ruleP(jsonSaxGrammar().value), eofP);
+    ParseContext ctx;
+    ctx.user = &h;
+    return documentP(ParseState(s, &ctx));
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include "jsonp.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <cstdint>
+
+// typed JSON: objects are read straight into a C++ struct through a list of
+// fields, each binding a key to a member and the parser for it, with no
+// JsonValue in between.
+//     struct Point { double x, y; };
+//     Parser<Point> pointP = structP<Point>({fieldP("x", &Point::x), fieldP("y", &Point::y)});
+
+template<typename T>
+struct IsVector : std::false_type {};
+template<typename T>
+struct IsVector<std::vector<T>> : std::true_type {};
+template<typename T>
+struct IsOptional : std::false_type {};
+template<typename T>
+struct IsOptional<std::optional<T>> : std::true_type {};
+
+// the parser a field of type T gets when none is given: JSON booleans,
+// numbers (integers must be integral literals that fit T), strings, arrays
+// of any of these as vectors, null or a value as optionals, or any value
+template<typename T>
+Parser<T> jsonTypeP() {
+    if constexpr (std::is_same_v<T, bool>) {
+        return trimP(mapP<size_t, bool>(keywordsP({"true", "false"}), [] (size_t i) { return i == 0; }));
+    } else if constexpr (std::is_integral_v<T>) {
+        return trimP(integralP<T>(std::is_signed_v<T>));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        return trimP(mapP<double, T>(doubleP, [] (double x) { return (T) x; }));
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return escapeStrP;
+    } else if constexpr (std::is_same_v<T, std::pmr::string>) {
+        return jsonStrP();
+    } else if constexpr (std::is_same_v<T, JsonValue>) {
+        return jsonP();
+    } else if constexpr (IsVector<T>::value) {
+        using E = typename T::value_type;
+        return trimP(betweenP(charP('['), trimP(charP(']')), sepByP<E, char, T>(jsonTypeP<E>(), charP(','))));
+    } else if constexpr (IsOptional<T>::value) {
+        using E = typename T::value_type;
+        return orP(mapP<std::string_view, T>(trimP(literalP("null")), [] (std::string_view) { return T(); }),
+                   mapP<E, T>(jsonTypeP<E>(), [] (E x) { return T(std::move(x)); }));
+    } else {
+        static_assert(IsVector<T>::value, "no default JSON parser for this type: pass one to fieldP");
+    }
+}
+
+// a key of S and how its value is read into a member
+template<typename S>
+struct JsonField {
+    std::string key;
+    std::function<ParseResult<bool>(ParseState, S &)> read;
+};
+
+template<typename S, typename M>
+JsonField<S> fieldP(std::string key, M S::*member, Parser<M> p = jsonTypeP<M>()) {
+    return JsonField<S>{std::move(key), [member, p] (ParseState s, S &x) {
+        ParseResult<M> r = p(s);
+        if (!r.success) return ParseResult<bool>(r.state, r.error);
+        if (!s.skipping()) x.*member = std::move(r.result);
+        return success(r.state, true);
+    }};
+}
+
+// a perfect hash over a fixed set of keys: each key has a slot of its own,
+// so finding the candidate for a key is one hash and one compare. the seed
+// and the table size are searched for once, when the hash is built.
+struct KeyHash {
+    explicit KeyHash(const std::vector<std::string> &keys) {
+        size_t size = 1;
+        while (size < 2 * keys.size()) size <<= 1;
+        for (;; size <<= 1) {
+            for (seed = 1; seed < 64; seed++) {
+                slots.assign(size, -1);
+                bool ok = true;
+                for (size_t i = 0; i < keys.size() && ok; i++) {
+                    long &slot = slots[hash(keys[i], seed) & (size - 1)];
+                    if (slot >= 0 && keys[slot] != keys[i]) ok = false;
+                    else slot = i;
+                }
+                if (ok) return;
+            }
+        }
+    }
+    // the only index key can be, or -1; the caller compares the key there
+    long find(std::string_view key) const {
+        return slots[hash(key, seed) & (slots.size() - 1)];
+    }
+    static constexpr uint64_t hash(std::string_view key, uint64_t seed) {
+        uint64_t h = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+        for (char c : key) h = (h ^ (unsigned char) c) * 0x100000001b3ULL;
+        return h ^ (h >> 29);
+    }
+private:
+    uint64_t seed;
+    std::vector<long> slots;
+};
+
+// a JSON object read into a default-constructed S. members the object does
+// not mention keep their defaults, a repeated key wins with its last value,
+// and the values of unknown keys are validated in skip mode and dropped.
+template<typename S>
+Parser<S> structP(std::vector<JsonField<S>> fields) {
+    std::vector<std::string> keys;
+    for (const JsonField<S> &f : fields) keys.push_back(f.key);
+    std::shared_ptr<const KeyHash> index = std::make_shared<KeyHash>(keys);
+    Parser<std::string_view> unknownP = skipP(jsonStackP());
+    Parser<S> p = [=] (ParseState s) {
+        ParseState t = skipSpace(s);
+        if (atEnd(t) || t.s[t.pos] != '{') return failure<S>(t, ERR_EXPECT_CHAR, '{');
+        t = skipSpace(t.advance(1));
+        S x{};
+        std::string decoded;
+        bool empty = !atEnd(t) && t.s[t.pos] == '}';
+        while (!empty) {
+            ParseResult<RawString> k = rawStringAt(t);
+            if (!k.success) return ParseResult<S>(k.state, k.error);
+            t = k.state;
+            if (atEnd(t) || t.s[t.pos] != ':') return failure<S>(t, ERR_EXPECT_CHAR, ':');
+            t = t.advance(1);
+            std::string_view key = k.result.raw;
+            if (k.result.escaped) {
+                decoded.clear();
+                unescapeTo(key, decoded);
+                key = decoded;
+            }
+            long i = index->find(key);
+            ParseResult<bool> r = i >= 0 && fields[i].key == key ? fields[i].read(t, x) : [&] {
+                ParseResult<std::string_view> u = unknownP(t);
+                return u.success ? success(u.state, true) : ParseResult<bool>(u.state, u.error);
+            }();
+            if (!r.success) return ParseResult<S>(r.state, r.error);
+            t = skipSpace(r.state);
+            if (!atEnd(t) && t.s[t.pos] == ',') {
+                t = t.advance(1);
+                continue;
+            }
+            break;
+        }
+        if (atEnd(t) || t.s[t.pos] != '}') return failure<S>(t, ERR_EXPECT_CHAR, '}');
+        return success(skipSpace(t.advance(1)), std::move(x));
+    };
+    p.first.known = true;
+    p.first.trim = true;
+    p.first.bytes.set('{');
+    return p;
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include "jsonp.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+#include <cstdint>
+
+// an on-demand front end: one structural pass records where every value
+// starts and ends in a flat tape, and nothing is decoded until a JsonRef
+// asks for it. reading a few fields of a large object costs one scan of the
+// input plus a walk over the tape entries in between.
+enum TapeKind : unsigned char {
+    TAPE_NULL,
+    TAPE_TRUE,
+    TAPE_FALSE,
+    TAPE_NUMBER,
+    TAPE_STRING,
+    TAPE_ARRAY,
+    TAPE_OBJECT
+};
+
+// objects store each member as its key string followed by its value. next
+// is the index after the whole value, so skipping a subtree is one jump.
+struct TapeEntry {
+    unsigned long long offset;  // first byte in the input, after the quote for strings
+    uint32_t size;              // bytes of a scalar, elements or members of a container
+    uint32_t next;
+    TapeKind kind;
+    bool escaped;               // a string with at least one backslash
+};
+
+struct JsonRef;
+
+// borrows the input, which must outlive the tape and every JsonRef into it
+struct JsonTape {
+    std::string_view input;
+    std::vector<TapeEntry> entries;
+    ParseError error{};
+    bool parse(std::string_view s);
+    JsonRef root() const;
+};
+
+struct JsonRef {
+    static const uint32_t none = UINT32_MAX;
+    const JsonTape *tape = nullptr;
+    uint32_t i = none;
+
+    explicit operator bool() const { return tape && i != none; }
+    TapeKind kind() const { return entry().kind; }
+    bool isNull() const { return kind() == TAPE_NULL; }
+    bool isBool() const { return kind() == TAPE_TRUE || kind() == TAPE_FALSE; }
+    bool isNumber() const { return kind() == TAPE_NUMBER; }
+    bool isString() const { return kind() == TAPE_STRING; }
+    bool isArray() const { return kind() == TAPE_ARRAY; }
+    bool isObject() const { return kind() == TAPE_OBJECT; }
+    // the bytes of a scalar as they appear in the input, without quotes
+    std::string_view raw() const {
+        return tape->input.substr(entry().offset, entry().size);
+    }
+    bool asBool() const { return kind() == TAPE_TRUE; }
+    // a literal past the double range reads as an infinity
+    double asNumber() const {
+        ParseResult<double> r = doubleP(ParseState(raw()));
+        return r.success ? r.result : (raw()[0] == '-' ? -HUGE_VAL : HUGE_VAL);
+    }
+    std::string asString() const {
+        if (!entry().escaped) return std::string(raw());
+        std::string s;
+        unescapeTo(raw(), s);
+        return s;
+    }
+    // elements of an array or members of an object
+    size_t size() const {
+        return isArray() || isObject() ? entry().size : 0;
+    }
+    // the n-th element of an array, found by skipping over the ones before
+    JsonRef at(size_t n) const {
+        if (!isArray() || n >= entry().size) return JsonRef{tape, none};
+        uint32_t j = i + 1;
+        while (n--) j = tape->entries[j].next;
+        return JsonRef{tape, j};
+    }
+    // the value of the last member named key, like JsonObject::find
+    JsonRef find(std::string_view key) const {
+        JsonRef r{tape, none};
+        if (!isObject()) return r;
+        for (uint32_t j = i + 1; j < entry().next; j = tape->entries[j + 1].next)
+            if (JsonRef{tape, j}.keyEquals(key)) r.i = j + 1;
+        return r;
+    }
+    JsonRef operator[](size_t n) const { return at(n); }
+    JsonRef operator[](std::string_view key) const { return find(key); }
+
+    // walks the elements of an array, or the member values of an object
+    // with key() naming each one
+    struct iterator {
+        const JsonTape *tape;
+        uint32_t j;
+        bool members;
+        JsonRef operator*() const { return JsonRef{tape, members ? j + 1 : j}; }
+        JsonRef key() const { return JsonRef{tape, j}; }
+        iterator &operator++() {
+            j = tape->entries[members ? j + 1 : j].next;
+            return *this;
+        }
+        bool operator!=(const iterator &o) const { return j != o.j; }
+        bool operator==(const iterator &o) const { return j == o.j; }
+    };
+    iterator begin() const {
+        bool c = isArray() || isObject();
+        return iterator{tape, c ? i + 1 : i, isObject()};
+    }
+    iterator end() const {
+        bool c = isArray() || isObject();
+        return iterator{tape, c ? entry().next : i, isObject()};
+    }
+
+    // builds the DOM for this value, with containers and strings on memory
+    JsonValue toValue(std::pmr::memory_resource *memory = std::pmr::get_default_resource()) const {
+        switch (kind()) {
+            case TAPE_NULL: return JsonValue();
+            case TAPE_TRUE: return JsonValue(true);
+            case TAPE_FALSE: return JsonValue(false);
+            case TAPE_NUMBER: return JsonValue(asNumber());
+            case TAPE_STRING: return JsonValue(pmrString(memory));
+            case TAPE_ARRAY: {
+                JsonArray xs(memory);
+                xs.reserve(size());
+                for (JsonRef x : *this) xs.push_back(x.toValue(memory));
+                return JsonValue(std::move(xs));
+            }
+            case TAPE_OBJECT: {
+                std::pmr::vector<JsonMember> items(memory);
+                items.reserve(size());
+                for (iterator it = begin(); it != end(); ++it)
+                    items.emplace_back(it.key().pmrString(memory), (*it).toValue(memory));
+                return JsonValue(JsonObject(std::move(items)));
+            }
+        }
+        return JsonValue();
+    }
+private:
+    const TapeEntry &entry() const { return tape->entries[i]; }
+    bool keyEquals(std::string_view key) const {
+        if (!entry().escaped) return raw() == key;
+        return asString() == key;
+    }
+    std::pmr::string pmrString(std::pmr::memory_resource *memory) const {
+        std::pmr::string s(memory);
+        if (entry().escaped) unescapeTo(raw(), s);
+        else s = raw();
+        return s;
+    }
+};
+
+JsonRef JsonTape::root() const {
+    return JsonRef{this, entries.empty() ? JsonRef::none : 0};
+}
+
+// validates s as one JSON value with the same grammar as jsonP() and fills
+// the tape; on failure error holds the offending offset and entries is
+// cleared. containers are tracked on an explicit stack, not by recursion.
+bool JsonTape::parse(std::string_view s) {
+    input = s;
+    entries.clear();
+    std::vector<uint32_t> open;
+    size_t pos = 0;
+    enum { VALUE, FIRST_VALUE, KEY, FIRST_KEY, AFTER } state = VALUE;
+    auto fail = [&] (unsigned long long p, ParseErrorCode code, char c = 0) {
+        error = ParseError{p, code, c};
+        entries.clear();
+        return false;
+    };
+    auto push = [&] (TapeKind kind, unsigned long long offset, size_t size, bool escaped = false) {
+        uint32_t n = entries.size();
+        entries.push_back(TapeEntry{offset, (uint32_t) size, n + 1, kind, escaped});
+    };
+    auto close = [&] () {
+        entries[open.back()].next = entries.size();
+        open.pop_back();
+    };
+    // pos is at the opening quote; leaves it after the whitespace that
+    // follows the closing one
+    auto scanString = [&] () {
+        ParseResult<RawString> r = rawStringAt(ParseState(pos, s));
+        if (!r.success) {
+            error = r.error;
+            return false;
+        }
+        push(TAPE_STRING, r.result.raw.data() - s.data(), r.result.raw.size(), r.result.escaped);
+        pos = r.state.pos;
+        return true;
+    };
+    while (true) {
+        pos = skipSpace(ParseState(pos, s)).pos;
+        if (state == AFTER) {
+            if (open.empty()) {
+                if (pos != s.size()) return fail(pos, ERR_EXPECT_EOF);
+                return true;
+            }
+            bool object = entries[open.back()].kind == TAPE_OBJECT;
+            if (pos == s.size()) return fail(pos, ERR_EOF);
+            if (s[pos] == ',') {
+                pos++;
+                state = object ? KEY : VALUE;
+            } else if (s[pos] == (object ? '}' : ']')) {
+                pos++;
+                close();
+            } else return fail(pos, ERR_EXPECT_CHAR, object ? '}' : ']');
+            continue;
+        }
+        if (pos == s.size()) return fail(pos, ERR_EOF);
+        char c = s[pos];
+        if ((state == FIRST_VALUE && c == ']') || (state == FIRST_KEY && c == '}')) {
+            pos++;
+            close();
+            state = AFTER;
+            continue;
+        }
+        if (state == KEY || state == FIRST_KEY) {
+            if (c != '"') return fail(pos, ERR_EXPECT_CHAR, '"');
+            if (!scanString()) return fail(error.pos, error.code, error.c);
+            pos = skipSpace(ParseState(pos, s)).pos;
+            if (pos == s.size()) return fail(pos, ERR_EOF);
+            if (s[pos] != ':') return fail(pos, ERR_EXPECT_CHAR, ':');
+            pos++;
+            state = VALUE;
+            continue;
+        }
+        if (!open.empty()) entries[open.back()].size++;
+        state = AFTER;
+        switch (c) {
+            case '[':
+            case '{':
+                open.push_back(entries.size());
+                push(c == '[' ? TAPE_ARRAY : TAPE_OBJECT, pos, 0);
+                pos++;
+                state = c == '[' ? FIRST_VALUE : FIRST_KEY;
+                break;
+            case '"':
+                if (!scanString()) return fail(error.pos, error.code, error.c);
+                break;
+            case 'n':
+            case 't':
+            case 'f': {
+                std::string_view lit = c == 'n' ? "null" : c == 't' ? "true" : "false";
+                ParseResult<std::string_view> r = literalAt(ParseState(pos, s), lit);
+                if (!r.success) return fail(r.error.pos, r.error.code, r.error.c);
+                push(c == 'n' ? TAPE_NULL : c == 't' ? TAPE_TRUE : TAPE_FALSE, pos, lit.size());
+                pos = r.state.pos;
+                break;
+            }
+            default: {
+                if (c != '-' && !digitClass[c]) return fail(pos, ERR_UNEXPECT, c);
+                ParseResult<size_t> r = numberSpan(ParseState(pos, s));
+                if (!r.success) return fail(r.error.pos, r.error.code, r.error.c);
+                push(TAPE_NUMBER, pos, r.result);
+                pos = r.state.pos;
+            }
+        }
+    }
+}
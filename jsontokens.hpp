@@ -0,0 +1,87 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include "jsonp.hpp"
+#include "lexer.hpp"
+#include <string_view>
+#include <memory_resource>
+
+// JSON in two phases. strings and numbers are validated by the lexer, so
+// the grammar only decodes them; whitespace is skipped there exactly once.
+// token kinds are the punctuation itself, '"' for a string, '0' for a
+// number and 'n', 't', 'f' for the literals.
+const Lexer &jsonLexer() {
+    static const Lexer lexer = [] {
+        Lexer l;
+        l.skip(spaceClass);
+        l.punct("[]{},:");
+        l.literal('n', "null").literal('t', "true").literal('f', "false");
+        l.rule('0', digitClass | CharClass("-"), numberSpan);
+        l.rule('"', CharClass("\""), [] (ParseState s) {
+            ParseResult<RawString> r = rawStringAt(s);
+            if (!r.success) return ParseResult<size_t>(r.state, r.error);
+            // rawStringAt also steps over the whitespace after the quote
+            return success(r.state, (size_t) (r.result.raw.data() + r.result.raw.size() + 1 - (s.s.data() + s.pos)));
+        });
+        return l;
+    }();
+    return lexer;
+}
+
+// the grammar of jsonP() over jsonLexer() tokens
+struct JsonTokenGrammar {
+    Rule<JsonValue> value, array, object;
+    JsonTokenGrammar() {
+        Parser<JsonValue> nullP = mapP<std::string_view, JsonValue>(tokenP('n'), [] (std::string_view) { return JsonValue(); });
+        Parser<JsonValue> trueP = mapP<std::string_view, JsonValue>(tokenP('t'), [] (std::string_view) { return JsonValue(true); });
+        Parser<JsonValue> falseP = mapP<std::string_view, JsonValue>(tokenP('f'), [] (std::string_view) { return JsonValue(false); });
+        // a literal past the double range is an error here too
+        Parser<JsonValue> numP = [] (ParseState s) {
+            ParseResult<std::string_view> t = tokenP('0')(s);
+            if (!t.success) return ParseResult<JsonValue>(t.state, t.error);
+            ParseResult<double> x = doubleP(ParseState(t.result));
+            if (!x.success) return failure<JsonValue>(s, x.error.code);
+            return success(t.state, JsonValue(x.result));
+        };
+        numP.first = tokenP('0').first;
+        Parser<JsonValue> strP = andP<std::pmr::memory_resource *, std::string_view, JsonValue>(memoryP, tokenP('"'),
+            [] (std::pmr::memory_resource *m, std::string_view t) {
+                std::string_view raw = t.substr(1, t.size() - 2);
+                std::pmr::string s(m);
+                if (raw.find('\\') == std::string_view::npos) s = raw;
+                else unescapeTo(raw, s);
+                return JsonValue(std::move(s));
+            });
+        strP.first = tokenP('"').first;
+        array = betweenP(tokenP('['), tokenP(']'),
+            mapP<JsonArray, JsonValue>(sepByP<JsonValue, std::string_view, JsonArray>(ruleP(value), tokenP(',')), [] (JsonArray xs) {
+                return JsonValue(std::move(xs));
+            }));
+        using items = std::pmr::vector<JsonMember>;
+        Parser<JsonKey> keyP = [] (ParseState s) {
+            ParseResult<std::string_view> t = tokenP('"')(s);
+            if (!t.success) return ParseResult<JsonKey>(t.state, t.error);
+            if (s.skipping()) return success(t.state, JsonKey());
+            std::string_view raw = t.result.substr(1, t.result.size() - 2);
+            return success(t.state, keyOf(s, RawString{raw, raw.find('\\') != std::string_view::npos}));
+        };
+        Parser<JsonMember> memberP = andP<JsonKey, JsonValue, JsonMember>(keyP, rightP(tokenP(':'), ruleP(value)),
+            [] (JsonKey k, JsonValue v) { return JsonMember(std::move(k), std::move(v)); });
+        object = betweenP(tokenP('{'), tokenP('}'),
+            mapP<items, JsonValue>(sepByP<JsonMember, std::string_view, items>(memberP, tokenP(',')), [] (items xs) {
+                return JsonValue(JsonObject(std::move(xs)));
+            }));
+        value = orP(nullP, trueP, falseP, numP, strP, ruleP(array), ruleP(object));
+    }
+};
+
+const JsonTokenGrammar &jsonTokenGrammar() {
+    static const JsonTokenGrammar g;
+    return g;
+}
+
+// s as one JSON document, lexed first and then parsed
+ParseResult<JsonValue> parseJsonTokens(std::string_view s, ParseContext ctx = ParseContext()) {
+    static const Parser<JsonValue> valueP = ruleP(jsonTokenGrammar().value);
+    return parseTokens(valueP, jsonLexer(), s, ctx);
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "charclass.hpp"
+#include "jsonp.hpp"
+#include "jsonsax.hpp"
+#include "jsontape.hpp"
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+#include <ostream>
+
+// serializes JSON into a buffer that is kept between documents: clear()
+// empties it without giving back its capacity. indent 0 writes compact
+// output, anything above it writes one element per line indented by that
+// many spaces per level.
+//
+// values come from write() for a JsonValue or a tape JsonRef, or as a
+// stream of events, so a writer can also be the handler of parseSax()
+// to reserialize a document without building it.
+struct JsonWriter final : JsonHandler {
+    explicit JsonWriter(int indent = 0): indent(indent) {}
+    std::string out;
+
+    void clear() {
+        out.clear();
+        depth = 0;
+        comma = afterKey = false;
+    }
+    std::string_view view() const {
+        return out;
+    }
+
+    void write(const JsonValue &v) {
+        switch (v.type) {
+            case JsonValue::JSON_NULL: onNull(); break;
+            case JsonValue::JSON_BOOL: onBool(v.boolValue); break;
+            case JsonValue::JSON_NUM: onNumber(v.numValue); break;
+            case JsonValue::JSON_STRING: onString(v.strValue); break;
+            case JsonValue::JSON_ARRAY:
+                onStartArray();
+                for (const JsonValue &x : v.arrayValue) write(x);
+                onEndArray();
+                break;
+            case JsonValue::JSON_OBJECT:
+                onStartObject();
+                for (const JsonMember &m : v.objectValue) {
+                    onKey(m.first);
+                    write(m.second);
+                }
+                onEndObject();
+                break;
+        }
+    }
+    // numbers, and strings without escapes, are copied out of the tape's
+    // input as they were written, as the input was validated when the tape
+    // was built. strings with escapes are decoded and escaped again, so
+    // they come out as write() of a JsonValue writes them. an empty ref
+    // is null.
+    void write(JsonRef r) {
+        if (!r) {
+            onNull();
+            return;
+        }
+        switch (r.kind()) {
+            case TAPE_NULL: onNull(); break;
+            case TAPE_TRUE: onBool(true); break;
+            case TAPE_FALSE: onBool(false); break;
+            case TAPE_NUMBER:
+                before();
+                out += r.raw();
+                comma = true;
+                break;
+            case TAPE_STRING:
+                before();
+                quoted(r.raw());
+                comma = true;
+                break;
+            case TAPE_ARRAY:
+                onStartArray();
+                for (JsonRef x : r) write(x);
+                onEndArray();
+                break;
+            case TAPE_OBJECT:
+                onStartObject();
+                for (auto it = r.begin(); it != r.end(); ++it) {
+                    before();
+                    quoted(it.key().raw());
+                    separator();
+                    write(*it);
+                }
+                onEndObject();
+                break;
+        }
+    }
+
+    bool onNull() override {
+        before();
+        out += "null";
+        comma = true;
+        return true;
+    }
+    bool onBool(bool b) override {
+        before();
+        out += b ? "true" : "false";
+        comma = true;
+        return true;
+    }
+    // the shortest digits that read back as the same double; JSON has no
+    // infinities or NaN, so those are written as null
+    bool onNumber(double x) override {
+        if (!std::isfinite(x)) return onNull();
+        before();
+        char b[32];
+        out.append(b, std::to_chars(b, b + sizeof(b), x).ptr);
+        comma = true;
+        return true;
+    }
+    bool onString(std::string_view s) override {
+        before();
+        escaped(s);
+        comma = true;
+        return true;
+    }
+    bool onKey(std::string_view s) override {
+        before();
+        escaped(s);
+        separator();
+        return true;
+    }
+    bool onStartArray() override {
+        return open('[');
+    }
+    bool onEndArray() override {
+        return close(']');
+    }
+    bool onStartObject() override {
+        return open('{');
+    }
+    bool onEndObject() override {
+        return close('}');
+    }
+private:
+    // what goes ahead of a value or key: nothing right after a key,
+    // otherwise the comma after its predecessor and, when pretty, its line
+    void before() {
+        if (afterKey) {
+            afterKey = false;
+            return;
+        }
+        if (comma) out += ',';
+        if (indent && depth) newline();
+    }
+    void separator() {
+        out += indent ? ": " : ":";
+        afterKey = true;
+    }
+    void newline() {
+        out += '\n';
+        out.append(size_t(indent) * depth, ' ');
+    }
+    bool open(char c) {
+        before();
+        out += c;
+        depth++;
+        comma = false;
+        return true;
+    }
+    // an empty container stays on one line
+    bool close(char c) {
+        depth--;
+        if (indent && comma) newline();
+        out += c;
+        comma = true;
+        return true;
+    }
+    void quoted(std::string_view raw) {
+        if (raw.find('\\') == std::string_view::npos) {
+            out += '"';
+            out += raw;
+            out += '"';
+            return;
+        }
+        decoded.clear();
+        unescapeTo(raw, decoded);
+        escaped(decoded);
+    }
+    // runs that need no escape are found a vector block at a time and
+    // appended whole. bytes past ASCII are copied as they are.
+    void escaped(std::string_view s) {
+        static const ClassScanner plain(~(CharClass("\"\\") | CharClass::range(0, 0x1f)));
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        size_t i = 0;
+        while (true) {
+            size_t n = plain.span(s.data() + i, s.size() - i);
+            out.append(s.data() + i, n);
+            i += n;
+            if (i == s.size()) break;
+            unsigned char c = s[i++];
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default: {
+                    char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                    out.append(u, sizeof(u));
+                }
+            }
+        }
+        out += '"';
+    }
+    int indent;
+    size_t depth = 0;
+    bool comma = false, afterKey = false;
+    // scratch for tape strings that have to be decoded
+    std::string decoded;
+};
+
+std::string toJson(const JsonValue &v, int indent = 0) {
+    JsonWriter w(indent);
+    w.write(v);
+    return std::move(w.out);
+}
+
+std::ostream &operator<<(std::ostream &os, const JsonValue &js) {
+    JsonWriter w;
+    w.write(js);
+    return os << w.view();
+}
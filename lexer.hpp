@@ -0,0 +1,146 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <functional>
+#include <cstdint>
+
+// a two-phase mode: a Lexer cuts the input into tokens once, whitespace
+// included, and grammars then run over the tokens instead of the bytes.
+//
+// the stream a token grammar sees is kinds, one byte per token, so every
+// combinator and every first-set dispatch works on it unchanged, with
+// offsets counting tokens. tokenP() reaches the bytes of a token through
+// the TokenStream of the parse, which parseTokens() puts in its context.
+struct Token {
+    unsigned long long offset;
+    uint32_t size;
+    char kind;
+};
+
+// borrows the input, which must outlive the stream
+struct TokenStream {
+    std::string_view input;
+    std::vector<Token> tokens;
+    std::string kinds;
+    std::string_view text(size_t i) const {
+        return input.substr(tokens[i].offset, tokens[i].size);
+    }
+    // the input offset of token i, or the end of the input past the last
+    unsigned long long offset(unsigned long long i) const {
+        return i < tokens.size() ? tokens[i].offset : input.size();
+    }
+};
+
+// a token is recognised by its first byte alone, through a 256-entry table:
+// a rule added for a byte replaces the one that had it. a rule's length
+// function gets the state at that byte and returns how many bytes the
+// token takes, or the failure that makes the input malformed there.
+struct Lexer {
+    using Length = std::function<ParseResult<size_t>(ParseState)>;
+    Lexer() {
+        table.fill(-1);
+    }
+    // bytes that separate tokens and are dropped
+    Lexer &skip(CharClass cls) {
+        blank = ClassScanner(cls);
+        return *this;
+    }
+    // each byte in chars a one-byte token whose kind is the byte itself
+    Lexer &punct(std::string_view chars) {
+        for (char c : chars) rule(c, CharClass(std::string(1, c)), [] (ParseState s) { return success(s.advance(1), size_t(1)); });
+        return *this;
+    }
+    // a byte in first followed by a run of bytes in rest
+    Lexer &span(char kind, CharClass first, CharClass rest) {
+        ClassScanner sc(rest);
+        return rule(kind, first, [sc] (ParseState s) {
+            size_t n = 1 + sc.span(s.s.data() + s.pos + 1, s.s.size() - s.pos - 1);
+            return success(s.advance(n), n);
+        });
+    }
+    // exactly lit, which starts with its first byte
+    Lexer &literal(char kind, std::string lit) {
+        return rule(kind, CharClass(lit.substr(0, 1)), [lit] (ParseState s) {
+            ParseResult<std::string_view> r = literalAt(s, lit);
+            if (!r.success) return ParseResult<size_t>(r.state, r.error);
+            return success(r.state, lit.size());
+        });
+    }
+    Lexer &rule(char kind, CharClass first, Length length) {
+        rules.push_back(Rule{kind, std::move(length)});
+        for (int b = 0; b < 256; b++)
+            if (first[b]) table[b] = rules.size() - 1;
+        return *this;
+    }
+    // fills out with the tokens of s; on failure error is the offending
+    // input offset and out holds the tokens before it
+    bool tokenize(std::string_view s, TokenStream &out, ParseError &error) const {
+        out.input = s;
+        out.tokens.clear();
+        out.kinds.clear();
+        size_t pos = 0;
+        while (true) {
+            pos += blank.span(s.data() + pos, s.size() - pos);
+            if (pos == s.size()) return true;
+            short r = table[(unsigned char) s[pos]];
+            if (r < 0) {
+                error = ParseError{pos, ERR_UNEXPECT, s[pos]};
+                return false;
+            }
+            ParseResult<size_t> n = rules[r].length(ParseState(pos, s));
+            if (!n.success) {
+                error = n.error;
+                return false;
+            }
+            out.tokens.push_back(Token{pos, (uint32_t) n.result, rules[r].kind});
+            out.kinds.push_back(rules[r].kind);
+            pos += n.result;
+        }
+    }
+private:
+    struct Rule {
+        char kind;
+        Length length;
+    };
+    std::array<short, 256> table;
+    std::vector<Rule> rules;
+    ClassScanner blank{CharClass()};
+};
+
+const TokenStream &tokensOf(ParseState s) {
+    return *s.ctx->tokens;
+}
+
+// the next token if it is of kind, as its bytes in the input
+Parser<std::string_view> tokenP(char kind) {
+    Parser<std::string_view> p = [=] (ParseState s) {
+        if (atEnd(s) || s.s[s.pos] != kind) return failure<std::string_view>(s, ERR_EXPECT_CHAR, kind);
+        return success(s.advance(1), tokensOf(s).text(s.pos));
+    };
+    p.first.known = true;
+    p.first.bytes.set((unsigned char) kind);
+    return p;
+}
+
+// tokenizes s with lexer and runs p over the tokens, to the end of them.
+// the error of a failure, from either phase, is an input offset.
+template<typename T>
+ParseResult<T> parseTokens(const Parser<T> &p, const Lexer &lexer, std::string_view s, ParseContext ctx = ParseContext()) {
+    TokenStream ts;
+    ParseError e;
+    if (!lexer.tokenize(s, ts, e)) return ParseResult<T>(ParseState(e.pos, s), e);
+    ctx.tokens = &ts;
+    ctx.source = nullptr;
+    ParseResult<T> r = leftP(p, eofP)(ParseState(ts.kinds, &ctx));
+    if (!r.success) {
+        r.error.pos = ts.offset(r.error.pos);
+        r.state = ParseState(r.error.pos, s);
+        return r;
+    }
+    r.state = ParseState(s.size(), s);
+    return r;
+}
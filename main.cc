@@ -4,18 +4,486 @@
 #include <iostream>
 #include <list>
 #include <map>
+#include <vector>
+#include <string>
 #include <utility>
+#include <fstream>
+#include <cstdio>
+#include <atomic>
+#include <sstream>
 #include "jsonp.hpp"
+#include "jsontape.hpp"
+#include "jsonsax.hpp"
+#include "incremental.hpp"
+#include "parsefile.hpp"
+#include "records.hpp"
+#include "jsonparallel.hpp"
+#include "jsonwriter.hpp"
+#include "operators.hpp"
+#include "jsontokens.hpp"
+#include "jsonstruct.hpp"
+#ifdef __cpp_impl_coroutine
+#include "asyncparse.hpp"
+#endif
 
 int main() {
     assert(parse(idP, "a").result == 'a');
+    assert(parse(idP, "ab" + 1, 1).result == 'b');
+    assert(parse(intP, std::string("-25")).result == -25);
     assert((parse(someP(oneOfP("a")), "aaa").result == std::list<char>{'a', 'a', 'a'}));
+    assert(parse(countP(charP('a')), std::string(1 << 20, 'a')).result == 1 << 20);
+    assert((parse(manyVecP(digitP, 4), "123x").result == std::vector<int>{1, 2, 3}));
+    assert(parse(someStrP(oneOfP("ab")), "abba!").result == "abba");
+    assert(parse(foldP<int, int>(digitP, 0, [] (int &a, int x) { a += x; }), "").result == 0);
+    assert(parse(spanP(CharClass::range('a', 'z') | CharClass("_")), "snake_case_identifier_longer_than_a_block = 1").result
+           == "snake_case_identifier_longer_than_a_block");
+    assert(parse(skipWhileP(spaceClass), std::string(100, ' ') + "x").result == 100);
+    assert(!parse(span1P(digitClass), "x").success);
     assert(parse(intP, "-25").result == -25);
+    assert(!parse(charP('a'), "b").success && parse(charP('a'), "b").error.message() == "expect a");
+    assert(parse(orP(stringP("ab"), stringP("ac")), "ad").error.pos == 1);
+    assert(parse(literalP("false"), "false!").result == "false" && parse(literalP("false"), "fals").error.pos == 4);
+    Parser<size_t> kw = keywordsP({"in", "int", "null", "true", "false"});
+    assert(parse(kw, "int x").result == 1 && parse(kw, "inx").result == 0 && parse(kw, "false").result == 4);
+    assert(!parse(kw, "nul").success && !parse(kw, "x").success);
+    assert(explain(leftP(jsonP(), eofP), "[1, 2") == "offset 5: unexpect end of file, expect ',' or ']'");
     assert(parse(doubleP, "12.25").result == 12.25);
+    assert(parse(doubleP, "-0.1e-2").result == -0.001 && parse(doubleP, "1E+2").result == 100);
+    assert(parse(doubleP, "0.1").result == 0.1 && parse(doubleP, "1e-400").result == 0);
+    assert(parse(doubleP, "1e400").error.code == ERR_OVERFLOW && parse(doubleP, "1.").error.code == ERR_EOF);
+    assert(parse(natP, "2147483648").error.code == ERR_OVERFLOW && !parse(natP, "-1").success);
+    assert(parse(int64P, "-9223372036854775808").result == INT64_MIN);
+    assert(parse(uint64P, "18446744073709551615").result == UINT64_MAX);
     assert(parse(jsonP(), "null").result == JsonValue());
     assert(parse(jsonP(), "true").result == JsonValue(true));
-    assert(parse(jsonP(), "[1, 2]").result == JsonValue(std::list<JsonValue>{JsonValue(1.0), JsonValue(2.0)}));
-    assert(parse(jsonP(), "{\"xyz\": 2, \"abc\": 1}").result == JsonValue(std::map<std::string, JsonValue>{
+    assert(parse(jsonP(), "[1, 2]").result == JsonValue(JsonArray{JsonValue(1.0), JsonValue(2.0)}));
+    assert(parse(jsonP(), "{\"xyz\": 2, \"abc\": 1}").result == JsonValue(JsonObject{
         {"abc", JsonValue(1.0)},
         {"xyz", JsonValue(2.0)}}));
-}
\ No newline at end of file
+    JsonValue obj = parse(jsonP(), "{\"xyz\": 2, \"abc\": [], \"xyz\": 3}").result;
+    assert(obj.objectValue[0].first == "xyz" && *obj.find("xyz") == JsonValue(3.0) && !obj.find("q"));
+    std::string wide = "{";
+    for (int i = 0; i < 40; i++) wide += "\"k" + std::to_string(i) + "\": " + std::to_string(i) + (i < 39 ? "," : "}");
+    JsonValue big = parse(jsonP(), wide).result;
+    assert(*big.find("k37") == JsonValue(37.0) && !big.find("k40"));
+    JsonDocument doc;
+    assert(doc.parse(wide) && *doc.root().find("k5") == JsonValue(5.0));
+    assert(doc.root().objectValue[0].first.own.get_allocator().resource() == doc.memory());
+    assert(!doc.parse("[1,") && doc.root() == JsonValue());
+    std::pmr::monotonic_buffer_resource arena;
+    ParseContext actx;
+    actx.memory = &arena;
+    assert(parse(memoryP, "", actx).result == &arena && parse(memoryP, "").result == std::pmr::get_default_resource());
+    JsonValue moved = std::move(big);
+    big = moved;
+    assert(big == moved && moved.find("k0"));
+    // an indexed object moved onto another resource, or grown, looks its keys up afresh
+    JsonValue onArena = parse(jsonP(), wide, actx).result;
+    assert(onArena.find("k37"));
+    JsonObject elsewhere(std::pmr::vector<JsonMember>(std::pmr::new_delete_resource()));
+    elsewhere = std::move(onArena.objectValue);
+    assert(elsewhere.get_allocator().resource() == std::pmr::new_delete_resource() && *elsewhere.find("k37") == JsonValue(37.0));
+    JsonObject grown = big.objectValue;
+    assert(grown.find("k1") && !grown.find("k40"));
+    grown.emplace("k40", JsonValue(40.0));
+    assert(*grown.find("k40") == JsonValue(40.0) && *grown.find("k1") == JsonValue(1.0) && grown.size() == 41);
+    Parser<int> sw = switchP<int>({{"ab", pureP(1)}, {"c", mapP<char, int>(charP('c'), [] (char) { return 2; })}}, true);
+    assert(parse(sw, "  c").result == 2 && parse(sw, "b").result == 1 && !parse(sw, "d").success);
+    assert(jsonP().first.known && parse(jsonP(), " \"q\" ").result == JsonValue(std::string("q")));
+    Rule<int> parens;
+    parens = orP(betweenP(charP('('), charP(')'), mapP<int, int>(ruleP(parens), [] (int n) { return n + 1; })), pureP(0));
+    assert(parse(ruleP(parens), "((()))").result == 3);
+    assert(parse(lazyP<int>([] { return natP; }), "42").result == 42);
+    assert((parse(sp::erase(sp::someP(sp::oneOfP("a"))), "aaa").result == std::list<char>{'a', 'a', 'a'}));
+    // a result built at the leaves is moved, not copied, up through every level
+    const char *leafData = nullptr;
+    auto leaf = sp::mapP(sp::literalP("abc"), [&leafData] (std::string_view v) {
+        std::string x(v);
+        x.resize(64);
+        leafData = x.data();
+        return x;
+    });
+    auto nestedLeaf = sp::mapP(sp::trimP(sp::manyP(sp::leftP(leaf, sp::charP(',')))), [] (std::list<std::string> xs) { return xs; });
+    assert(parse(sp::erase(nestedLeaf), " abc, ").result.front().data() == leafData);
+    ParseResult<std::list<bool>> blanks = parse(sp::erase(sp::manyP(sp::spaces)), "  x");
+    assert(blanks.result.size() == 1 && blanks.state.pos == 2);
+    assert(parse(sp::erase(sp::manyP(sp::pureP(1))), "x").result.empty() && parse(sp::erase(sp::someP(sp::pureP(1))), "x").result.size() == 1);
+    assert(parse(sp::erase(sp::mapP(sp::trimP(sp::charP('x')), [] (char c) { return c == 'x'; })), " x ").result);
+    assert((parse(sp::jsonP(), "{\"a\": [1, true, null, \"s\\n\"], \"b\": {}}").result
+            == parse(jsonP(), "{\"a\": [1, true, null, \"s\\n\"], \"b\": {}}").result));
+    JsonTape tape;
+    std::string msg = "{\"id\": 7, \"tags\": [\"a\", \"b\\n\"], \"id\": -1.5e2, \"meta\": {\"ok\": true, \"x\": null}}";
+    assert(tape.parse(msg) && tape.root().size() == 4 && tape.root()["id"].asNumber() == -150);
+    assert(tape.root()["tags"][1].asString() == "b\n" && tape.root()["tags"][0].raw() == "a" && !tape.root()["q"]);
+    assert(tape.root()["meta"]["ok"].asBool() && tape.root()["meta"]["x"].isNull());
+    assert(tape.root().toValue() == parse(jsonP(), msg).result);
+    assert(tape.parse(" [] ") && tape.root().size() == 0 && tape.root().begin() == tape.root().end());
+    assert(!tape.parse("{\"a\": [1 2]}") && tape.error == (ParseError{9, ERR_EXPECT_CHAR, ']'}));
+    assert(!tape.parse("[1] x") && tape.error.code == ERR_EXPECT_EOF && !tape.parse("{\"a\""));
+    struct Events : JsonHandler {
+        std::string log;
+        std::string stopAt;
+        bool onNull() override { log += 'n'; return true; }
+        bool onBool(bool b) override { log += b ? 't' : 'f'; return true; }
+        bool onNumber(double x) override { log += std::to_string((int) x); return true; }
+        bool onString(std::string_view s) override { log += "'" + std::string(s) + "'"; return true; }
+        bool onKey(std::string_view k) override { log += std::string(k) + ":"; return k != stopAt; }
+        bool onStartArray() override { log += '['; return true; }
+        bool onEndArray() override { log += ']'; return true; }
+        bool onStartObject() override { log += '{'; return true; }
+        bool onEndObject() override { log += '}'; return true; }
+    } events;
+    assert(parseSax(msg, events).success && events.log == "{id:7tags:['a''b\n']id:-150meta:{ok:tx:n}}");
+    events.log.clear();
+    events.stopAt = "tags";
+    ParseResult<bool> stopped = parseSax(msg, events);
+    assert(!stopped.success && stopped.error.code == ERR_ABORT && events.log == "{id:7tags:");
+    assert(!parseSax("[1, 2", events).success && explain(ruleP(jsonSaxGrammar().value), "[1 2]") != "");
+    int calls = 0;
+    Parser<int> counted = mapP<int, int>(natP, [&calls] (int n) { calls++; return n; });
+    assert(parse(skipP(sepByP<int, char>(counted, charP(','))), "1,2,3!").result == "1,2,3" && calls == 0);
+    assert(parse(skipP(jsonP()), msg).result == msg && !parse(skipP(jsonP()), "[1, {\"a\" 2}]").success);
+    assert(parse(skipP(jsonP()), "[1, {\"a\" 2}]").error == parse(jsonP(), "[1, {\"a\" 2}]").error);
+    assert(parse(skipValueP(), " {\"a\": [1, \"]}\\\"\"], \"b\": {}} ,").result == "{\"a\": [1, \"]}\\\"\"], \"b\": {}}");
+    assert(parse(skipValueP(), "-1.5e3]").result == "-1.5e3" && !parse(skipValueP(), "[[1]").success);
+    assert(parse(leftP(sepByP<std::string_view, char>(skipValueP(), charP(',')), eofP), "1, [2], \"3\"").result.size() == 3);
+    IncrementalParser<JsonValue> stream(leftP(jsonP(), eofP));
+    for (size_t i = 0; i + 1 < msg.size(); i++) assert(stream.feed(msg.substr(i, 1)).error.code == ERR_NEED_MORE);
+    assert(!stream.feed(msg.substr(msg.size() - 1)).success && stream.finish().success);
+    assert(stream.done() && stream.finish().result == parse(jsonP(), msg).result);
+    calls = 0;
+    IncrementalParser<std::vector<int>> nums(sepByP<int, char>(counted, charP(',')));
+    nums.feed("12,3");
+    nums.feed("4,5");
+    assert(calls == 2 && nums.finish().result == (std::vector<int>{12, 34, 5}) && calls == 3);
+    IncrementalParser<JsonValue> cut(jsonP());
+    cut.feed("[1, ");
+    assert(cut.finish().error == parse(jsonP(), "[1, ").error);
+    IncrementalParser<JsonValue> small(jsonP(), ParseContext(), 4096);
+    assert(small.feed("[" + std::string(3000, ' ')).error.code == ERR_NEED_MORE);
+    assert(small.feed(std::string(2000, ' ')).error == (ParseError{3001, ERR_CAPACITY, 0}) && small.done());
+    assert(small.finish().error.message() == "input exceeds capacity");
+    IncrementalParser<JsonValue> dropped(jsonP());
+    dropped.feed("{\"a\": [\"b\"");
+    std::string path = "/tmp/cparsec_main_test.json";
+    std::ofstream(path) << msg;
+    FileParseResult<JsonValue> fromFile = parseFile(jsonP(), path);
+    assert(fromFile.success && fromFile.result == parse(jsonP(), msg).result);
+    std::ofstream(path) << "[\"ab\", \"c\\td\"]";
+    FileParseResult<std::vector<std::string_view>> keys = parseFile(
+        betweenP(charP('['), charP(']'), sepByP<std::string_view, char>(jsonStrViewP(), charP(','))), path);
+    assert(keys.success && keys.result[0] == "ab" && keys.result[1] == "c\td");
+    assert(keys.result[0].data() == keys.file->data + 2 && keys.result[1].data() != keys.file->data + 8);
+    std::remove(path.c_str());
+    assert(parseFile(jsonP(), path).error.code == ERR_IO);
+    std::string lines;
+    for (int i = 0; i < 30000; i++) lines += "{\"n\": " + std::to_string(i) + ", \"s\": \"x\\ty\"}\r\n" + (i % 7 ? "" : "\n");
+    lines += "[1 2]\n";
+    WorkPool pool(4);
+    Records<JsonValue> recs = parseRecords(jsonP(), lines, pool);
+    assert(recs.results.size() == 30001 && recs.results[29999].success && !recs.results[30000].success);
+    for (int i = 0; i < 30000; i += 997) {
+        assert(*recs.results[i].result.find("n") == JsonValue((double) i));
+        std::pmr::memory_resource *m = recs.results[i].result.objectValue.get_allocator().resource();
+        assert(std::any_of(recs.arenas.begin(), recs.arenas.end(), [m] (const auto &a) { return a.get() == m; }));
+    }
+    assert(recs.results[30000].error == (ParseError{lines.size() - 3, ERR_EXPECT_CHAR, ']'}));
+    std::atomic<long> total{0};
+    forEachRecord(jsonP(), lines, [&] (unsigned long long, ParseResult<JsonValue> &r) {
+        if (r.success) total += (long) r.result.find("n")->numValue;
+    }, pool);
+    assert(total == 30000L * 29999 / 2 && parseRecords(jsonP(), "1\n\n2").results.size() == 2);
+    assert(parseRecords(jsonP(), "1 x\n").results[0].error == (ParseError{2, ERR_EXPECT_EOF, 0}));
+    std::string huge = "[";
+    for (int i = 0; i < 5000; i++) huge += (i ? ", " : " ") + std::string(i % 3 ? "{\"k\": [\"a,]\", " + std::to_string(i) + "]}" : "\"s\\\"]\"");
+    huge += " ] ";
+    assert(parse(parallelArrayP(pool, 0), huge).result == parse(arrayP(), huge).result);
+    assert(parse(parallelArrayP(pool, 0), huge, actx).result.arrayValue.get_allocator().resource() == &arena);
+    ParseResult<JsonValue> onArenas = parse(parallelArrayP(pool, 0), huge, actx);
+    assert(onArenas.result == parse(arrayP(), huge).result);
+    // elements stay in the worker arenas carved out of the parse's arena
+    std::pmr::memory_resource *sub = onArenas.result.arrayValue[1].objectValue.get_allocator().resource();
+    assert(sub != &arena && dynamic_cast<std::pmr::monotonic_buffer_resource *>(sub));
+    // the threshold counts the array, not the input after it
+    std::string padded = "[{\"a\": [1]}]" + std::string(2000, ' ');
+    assert(parse(parallelArrayP(pool, 1000), padded, actx).result.arrayValue[0].objectValue.get_allocator().resource() == &arena);
+    // a resource that is not an arena gets back everything but the result
+    struct Counted : std::pmr::memory_resource {
+        long live = 0;
+        void *do_allocate(size_t n, size_t align) override {
+            live++;
+            return std::pmr::new_delete_resource()->allocate(n, align);
+        }
+        void do_deallocate(void *p, size_t n, size_t align) override {
+            live--;
+            std::pmr::new_delete_resource()->deallocate(p, n, align);
+        }
+        bool do_is_equal(const std::pmr::memory_resource &o) const noexcept override {
+            return this == &o;
+        }
+    } tracked;
+    ParseContext cctx;
+    cctx.memory = &tracked;
+    {
+        ParseResult<JsonValue> r = parse(parallelArrayP(pool, 0), huge, cctx);
+        assert(r.success && r.result.arrayValue[1].objectValue.get_allocator().resource() == &tracked);
+        assert(r.result == parse(arrayP(), huge).result && tracked.live > 0);
+    }
+    assert(tracked.live == 0);
+    std::string arrays;
+    for (int i = 0; i < 5000; i++) arrays += "[" + std::to_string(i) + ", {\"a\": [\"b\"]}, " + std::to_string(-i) + "]\n";
+    Records<JsonValue> reentered = parseRecords(parallelArrayP(pool, 0), arrays, pool), flat = parseRecords(arrayP(), arrays, pool);
+    assert(reentered.results.size() == 5000 && reentered.results == flat.results);
+    std::string broken = huge;
+    broken.insert(broken.find("}, ", broken.size() / 2) + 2, "x");
+    assert(!parse(arrayP(), broken).success && parse(parallelArrayP(pool, 0), broken).error == parse(arrayP(), broken).error);
+    assert(parse(parallelArrayP(pool, 0), "[1,]").error == parse(arrayP(), "[1,]").error);
+    assert(parse(parallelArrayP(pool, 0), "[\"abc\\").error == parse(arrayP(), "[\"abc\\").error);
+    assert(parse(parallelArrayP(pool, 0), "").error == parse(arrayP(), "").error);
+    assert(parse(parallelArrayP(pool, 0), "  ").error == parse(arrayP(), "  ").error);
+    assert(parse(jsonP(), "{ }").success && parse(sp::jsonP(), "[ ]").success && parseSax("[ { } ]", events).success);
+    assert(parse(parallelArrayP(pool, 0), " [ ] ").result == JsonValue(JsonArray()) && parse(parallelArrayP(pool), "[1]").success);
+    assert(parse(escapeStrP, " \"a\\u00e9\\u4e2d\\ud83d\\ude00\\\"\" ").result == "a\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80\"");
+    assert(parse(jsonStrViewP(), "\"caf\xc3\xa9 \xe2\x82\xac\"").result == "caf\xc3\xa9 \xe2\x82\xac");
+    assert(parse(escapeStrP, "\"ab\xc3(\"").error == (ParseError{3, ERR_UNEXPECT, '\xc3'}));
+    assert(parse(escapeStrP, "\"\xed\xa0\x80\"").error.pos == 1 && !parse(escapeStrP, "\"\xc0\xaf\"").success);
+    assert(parse(escapeStrP, "\"x\\ud83d\"").error == (ParseError{2, ERR_UNEXPECT, '\\'}) && !parse(escapeStrP, "\"\\ude00\"").success);
+    assert(!parse(escapeStrP, "\"\\u12g4\"").success && parse(escapeStrP, "\"\\u12").error.code == ERR_EOF);
+    assert(tape.parse("[\"\\u00e9\"]") && tape.root()[0].asString() == "\xc3\xa9" && !tape.parse("[\"\xff\"]"));
+    std::string text = "{\"a\": [1, 0.1, -2.5e-300, true, null], \"b\\n\": \"q\\\"\\u0001\\u00e9\", \"c\": {}, \"d\": [ ]}";
+    std::string compact = "{\"a\":[1,0.1,-2.5e-300,true,null],\"b\\n\":\"q\\\"\\u0001\xc3\xa9\",\"c\":{},\"d\":[]}";
+    JsonDocument jd;
+    assert(jd.parse(text) && toJson(jd.root()) == compact);
+    assert(toJson(jd.root(), 2) == "{\n  \"a\": [\n    1,\n    0.1,\n    -2.5e-300,\n    true,\n    null\n  ],\n"
+                                    "  \"b\\n\": \"q\\\"\\u0001\xc3\xa9\",\n  \"c\": {},\n  \"d\": []\n}");
+    JsonWriter w;
+    assert(tape.parse(text));
+    w.write(tape.root());
+    assert(w.view() == compact);
+    w.clear();
+    assert(tape.parse("{\"\\/\": [\"\\u000b\", \"plain\"]}"));
+    w.write(tape.root());
+    assert(w.view() == "{\"/\":[\"\\u000b\",\"plain\"]}");
+    // escapes and raw bytes that RFC 8259 does not allow
+    assert(parse(escapeStrP, "\"a\\q\"").error == (ParseError{2, ERR_ESCAPE, 'q'}));
+    assert(parse(jsonP(), "\"\\v\"").error.code == ERR_ESCAPE && parse(jsonP(), "\"\\'\"").error.code == ERR_ESCAPE);
+    assert(parse(escapeStrP, "\"\\u12g4\"").error == (ParseError{1, ERR_ESCAPE, 'u'}));
+    assert(parse(escapeStrP, "\"\\ud83d\\uzzzz\"").error == (ParseError{7, ERR_ESCAPE, 'u'}));
+    assert(parse(escapeStrP, "\"a\tb\"").error == (ParseError{2, ERR_UNEXPECT, '\t'}));
+    assert(parse(escapeStrP, std::string("\"\0\"", 3)).error.code == ERR_UNEXPECT);
+    assert(!tape.parse("[\"\\q\"]") && tape.error.code == ERR_ESCAPE && !tape.parse("[\"a\nb\"]"));
+    assert(parseSax("\"\\x41\"", events).error.code == ERR_ESCAPE && !parseSax("{\"\x01\": 1}", events).success);
+    assert(parse(escapeStrP, "\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\"").result == "\"\\/\b\f\n\r\t\xc3\xa9");
+    w.clear();
+    assert(parseSax(text, w).success && w.view() == compact);
+    w.clear();
+    w.write(JsonValue(JsonArray{JsonValue(HUGE_VAL), JsonValue(1e21), JsonValue(-0.0)}));
+    assert(w.view() == "[null,1e+21,-0]");
+    std::ostringstream os;
+    os << JsonValue(JsonObject{{"k", JsonValue("v")}});
+    assert(os.str() == "{\"k\":\"v\"}");
+    // e = '(' e ')' 'a' | '(' e ')' 'b' | 'z', exponential without the table
+    Rule<int> nest;
+    calls = 0;
+    Parser<int> inner = memoP(mapP<int, int>(betweenP(charP('('), charP(')'), ruleP(nest)), [&calls] (int n) { calls++; return n + 1; }));
+    nest = orP(leftP(inner, charP('a')), leftP(inner, charP('b')), mapP<char, int>(charP('z'), [] (char) { return 0; }));
+    std::string deep = "z";
+    for (int i = 0; i < 16; i++) deep = "(" + deep + ")b";
+    assert(parse(ruleP(nest), deep).result == 16 && calls == 131070);
+    MemoTable memo;
+    ParseContext mc;
+    mc.memo = &memo;
+    calls = 0;
+    assert(parse(ruleP(nest), deep, mc).result == 16 && calls == 16);
+    assert(parse(ruleP(nest), "((z)b)c", mc).error == (ParseError{6, ERR_EXPECT_CHAR, 'b'}));
+    assert(explain(ruleP(nest), "(z)c") == "offset 3: unexpect 'c', expect 'a' or 'b'");
+    MemoTable narrow(1);
+    mc.memo = &narrow;
+    assert(parse(ruleP(nest), deep, mc).result == 16 && parse(skipP(ruleP(nest)), deep, mc).result == deep);
+    Parser<std::string> committed = orP(cutP(charP('a'), stringP("b")), stringP("ac"));
+    assert(parse(orP(rightP(charP('a'), stringP("b")), stringP("ac")), "ac").result == "ac");
+    assert(parse(committed, "ac").error == (ParseError{1, ERR_EXPECT_CHAR, 'b'}) && parse(committed, "ac").error.fatal());
+    assert(parse(manyP(committed), "abab").result.size() == 2 && parse(manyP(committed), "abax").error.pos == 3);
+    assert(parse(committed, "x").error.pos == 0 && !parse(committed, "x").error.fatal());
+    Parser<std::string> cutLater = seqOrP<std::string>({stringP("abcdefg"), cutP(charP('a'), stringP("x")), stringP("abz")});
+    assert(parse(cutLater, "abz").error == (ParseError{1, ERR_EXPECT_CHAR, 'x'}) && parse(cutLater, "abz").error.fatal());
+    Parser<std::string> spCutLater = sp::erase(sp::orP(sp::erase(stringP("abcdefg")), sp::erase(cutP(charP('a'), stringP("x"))),
+                                                       sp::erase(stringP("abz"))));
+    assert(parse(spCutLater, "abz").error == parse(cutLater, "abz").error && parse(spCutLater, "abz").error.fatal());
+    IncrementalParser<std::vector<int>> records(manyVecP(cutP(charP('{'), leftP(natP, charP('}')))));
+    records.discardCommitted();
+    std::string block;
+    for (int i = 0; i < 4096; i++) block += "{" + std::to_string(i % 10) + "}";
+    records.feed(block);
+    records.feed(block);
+    assert(records.view()[0] == 0 && records.view().substr(records.view().size() - 3) == "{5}");
+    assert(records.finish().result.size() == 8192 && records.finish().result[8191] == 5);
+    using IntOp = std::function<int(int, int)>;
+    Parser<IntOp> minus = mapP<char, IntOp>(charP('-'), [] (char) { return IntOp([] (int a, int b) { return a - b; }); });
+    Parser<IntOp> power = mapP<char, IntOp>(charP('^'), [] (char) { return IntOp([] (int a, int b) { return a * a * b; }); });
+    assert(parse(chainl1P(natP, minus), "10-2-3-").result == 5 && parse(chainl1P(natP, minus), "10-2-3-").state.pos == 6);
+    assert(parse(chainr1P(natP, power), "2^3^1").result == 2 * 2 * 9 && !parse(chainr1P(natP, power), "^1").success);
+    OperatorTable<long> ops;
+    Rule<long> expr;
+    auto atomP = orP(mapP<int, long>(natP, [] (int n) { return (long) n; }),
+                     betweenP(charP('('), trimP(charP(')')), ruleP(expr)));
+    expr = prattP(trimP(atomP), ops);
+    ops.infix("+", 10, OperatorTable<long>::LEFT, [] (long a, long b) { return a + b; });
+    ops.infix("-", 10, OperatorTable<long>::LEFT, [] (long a, long b) { return a - b; });
+    ops.infix("*", 20, OperatorTable<long>::LEFT, [] (long a, long b) { return a * b; });
+    ops.prefix("-", 25, [] (long a) { return -a; });
+    ops.infix("**", 30, OperatorTable<long>::RIGHT, [] (long a, long b) { long r = 1; while (b-- > 0) r *= a; return r; });
+    assert(parse(ruleP(expr), "1 + 2 * 3 - 4").result == 3 && parse(ruleP(expr), "2 ** 3 ** 2").result == 512);
+    assert(parse(ruleP(expr), "-2 ** 2").result == -4 && parse(ruleP(expr), "- -3 * (1+2)").result == 9);
+    assert(parse(ruleP(expr), "10 - 2 - 3").result == 5 && parse(ruleP(expr), "7 * 2 -").state.pos == 6);
+    assert(parse(ruleP(expr), "-").error.pos == 1 && parse(ruleP(expr), "(1 + )").error == (ParseError{3, ERR_EXPECT_CHAR, ')'}));
+    std::string chain = "1";
+    for (int i = 0; i < 100000; i++) chain += "+1";
+    assert(parse(ruleP(expr), chain).result == 100001 && parse(skipP(ruleP(expr)), chain).result == chain);
+    ops.remove("*");
+    ops.infix("%", 20, OperatorTable<long>::LEFT, [] (long a, long b) { return a % b; });
+    assert(parse(ruleP(expr), "1 + 7 % 4 * 2").result == 4 && parse(ruleP(expr), "1 + 7 % 4 * 2").state.pos == 10);
+    Parser<JsonValue> stackP = jsonStackP(64);
+    for (std::string d : {std::string(" {\"a\": [1, {\"b\": null}, [], {}], \"c\" : \"d\\n\", \"a\": [ true ]} "), text, msg,
+                          std::string("[1,]"), std::string("{\"a\" 1}"), std::string("[1 2]"), std::string("{\"a\": }"),
+                          std::string("[[1], [2"), std::string("{,}"), std::string("[\"x]"), std::string(""), std::string("-")}) {
+        ParseResult<JsonValue> a = parse(jsonP(), d), b = parse(stackP, d);
+        assert(a.success == b.success && (!a.success || (a.result == b.result && a.state.pos == b.state.pos)));
+    }
+    assert(parse(stackP, "[[1], [2").error == (ParseError{8, ERR_EXPECT_CHAR, ']'}) && parse(stackP, "{\"a\" 1}").error.pos == 5);
+    std::string hostile(100000, '[');
+    assert(parse(jsonStackP(), hostile).error == (ParseError{1024, ERR_DEPTH, 0}) && parse(jsonStackP(), hostile).error.fatal());
+    assert(parse(manyP(jsonStackP()), "1 " + hostile).error.code == ERR_DEPTH);
+    std::string nested = std::string(1024, '[') + std::string(1024, ']');
+    JsonValue nv = parse(jsonStackP(), nested).result;
+    assert(nv.type == JsonValue::JSON_ARRAY && nv.arrayValue.size() == 1 && !parse(jsonStackP(1023), nested).success);
+    assert(parse(skipP(jsonStackP()), nested + " x").result == nested + " ");
+    for (std::string d : {std::string(" {\"a\": [1, {\"b\": null}, [], {}], \"c\" : \"d\\n\", \"a\": [ true ]} "), text, msg,
+                          std::string("[1,]"), std::string("{\"a\" 1}"), std::string("[1 2]"), std::string("0 1"), std::string("truex")}) {
+        ParseResult<JsonValue> a = parse(leftP(jsonP(), eofP), d), b = parseJsonTokens(d);
+        assert(a.success == b.success && (!a.success || a.result == b.result));
+    }
+    assert(parseJsonTokens("[1, 2 x]").error == (ParseError{6, ERR_UNEXPECT, 'x'}));
+    assert(parseJsonTokens("[1, 2 3]").error == (ParseError{6, ERR_EXPECT_CHAR, ']'}) && parseJsonTokens(" 1e999").error == (ParseError{1, ERR_OVERFLOW, 0}));
+    Lexer calc;
+    calc.skip(spaceClass).punct("+*()").span('1', digitClass, digitClass);
+    Rule<long> sum;
+    Parser<long> num = mapP<std::string_view, long>(tokenP('1'), [] (std::string_view t) { return std::stol(std::string(t)); });
+    Parser<long> factor = orP(num, cutP(tokenP('('), leftP(ruleP(sum), tokenP(')'))));
+    auto binop = [] (char c, std::function<long(long, long)> f) {
+        return mapP<std::string_view, std::function<long(long, long)>>(tokenP(c), [f] (std::string_view) { return f; });
+    };
+    sum = chainl1P(chainl1P(factor, binop('*', [] (long a, long b) { return a * b; })), binop('+', [] (long a, long b) { return a + b; }));
+    assert(parseTokens(ruleP(sum), calc, " 2 * (3 + 4) + 10 ").result == 24);
+    assert(parseTokens(ruleP(sum), calc, "2 * (3 + ) ").error == (ParseError{7, ERR_EXPECT_CHAR, ')'}));
+    assert(parseTokens(ruleP(sum), calc, "2 - 1").error == (ParseError{2, ERR_UNEXPECT, '-'}));
+    KeyPool keyPool(3, 8);
+    ParseContext kc;
+    kc.keys = &keyPool;
+    std::string keyed = "{\"id\": 1, \"n\\u0061me\": \"x\", \"tags\": [{\"id\": 2}], \"long_key_name\": 3, \"z\": 4}";
+    JsonValue k1 = parse(jsonP(), keyed, kc).result, k2 = parse(jsonStackP(), keyed, kc).result;
+    assert(keyPool.size() == 3 && keyPool.find("name") && !keyPool.find("long_key_name") && !keyPool.find("z"));
+    assert(k1 == parse(jsonP(), keyed).result && k2 == k1 && parseJsonTokens(keyed, kc).result == k1);
+    const std::string *id = keyPool.find("id");
+    assert(k1.objectValue[0].first.pooled == id && k2.objectValue[0].first.pooled == id);
+    assert(*k1.find(id) == JsonValue(1.0) && *k1.find(keyPool.find("name")) == JsonValue("x") && k1.find(keyPool.find("tags"))->arrayValue[0].find(id));
+    assert(k1.objectValue[3].first.pooled == nullptr && *k1.find("long_key_name") == JsonValue(3.0));
+    assert(toJson(k1) == toJson(parse(jsonP(), keyed).result));
+    JsonValue twice = parse(jsonP(), "{\"a\": 1, \"a\": 1}").result, ab = parse(jsonP(), "{\"a\": 1, \"b\": 2}").result;
+    assert(!(twice == ab) && !(ab == twice));
+    struct Point {
+        double x = 0, y = 0;
+    };
+    struct Event {
+        int64_t id = 0;
+        std::string name;
+        double score = 0;
+        bool ok = false;
+        std::vector<int> tags;
+        Point at;
+        std::optional<std::string> note = std::string("none");
+    };
+    Parser<Point> pointP = structP<Point>({fieldP("x", &Point::x), fieldP("y", &Point::y)});
+    Parser<Event> eventP = structP<Event>({fieldP("id", &Event::id), fieldP("name", &Event::name), fieldP("score", &Event::score),
+        fieldP("ok", &Event::ok), fieldP("tags", &Event::tags), fieldP("at", &Event::at, pointP), fieldP("note", &Event::note)});
+    std::string event = " { \"id\": -7, \"n\\u0061me\": \"a\\tb\", \"extra\": {\"deep\": [1, {\"x\": null}]}, \"score\": 2.5,"
+                        " \"ok\": true, \"tags\": [1, 2, 3], \"at\": {\"y\": 4, \"x\": 3}, \"note\": null, \"id\": 8 } ";
+    ParseResult<Event> ev = parse(leftP(eventP, eofP), event);
+    assert(ev.success && ev.result.id == 8 && ev.result.name == "a\tb" && ev.result.score == 2.5 && ev.result.ok);
+    assert((ev.result.tags == std::vector<int>{1, 2, 3}) && ev.result.at.x == 3 && ev.result.at.y == 4 && !ev.result.note);
+    Event ev2 = parse(eventP, "{\"note\": \"hi\", \"tags\": []}").result;
+    assert(ev2.id == 0 && ev2.tags.empty() && *ev2.note == "hi" && parse(eventP, "{}").success);
+    assert(parse(eventP, "{\"id\": 1.5}").error == (ParseError{8, ERR_EXPECT_CHAR, '}'}));
+    assert(parse(eventP, "{\"ok\": 1}").error.pos == 7 && parse(eventP, "{\"extra\": [1,]}").error.pos == 13);
+    assert(parse(eventP, "{\"at\": {\"x\": 1} \"id\": 2}").error == (ParseError{16, ERR_EXPECT_CHAR, '}'}));
+    assert(parse(manyVecP(pointP), "{\"x\": 1} {\"y\": 2}").result.size() == 2);
+    assert(parse(namedP("int", intP), "12").result == 12);
+#ifdef __cpp_impl_coroutine
+    // chunks arrive one at a time from a stand-in for a reactor's socket
+    struct Socket {
+        std::vector<std::string> chunks;
+        size_t next = 0;
+        std::coroutine_handle<> waiting;
+        explicit Socket(std::vector<std::string> chunks): chunks(std::move(chunks)) {}
+        auto read() {
+            struct Read {
+                Socket &s;
+                bool await_ready() {
+                    return false;
+                }
+                void await_suspend(std::coroutine_handle<> h) {
+                    s.waiting = h;
+                }
+                std::string_view await_resume() {
+                    return s.chunks[s.next++];
+                }
+            };
+            return Read{*this};
+        }
+        void deliver() {
+            std::exchange(waiting, nullptr).resume();
+        }
+    };
+    Socket s1({"{\"a\": [1, ", "2]", "}", ""}), s2({"[tr", "ue]", ""});
+    AsyncParser<JsonValue> a1(leftP(jsonP(), eofP), ParseContext(), 1 << 20, 256 << 10), a2(jsonP());
+    ParseTask<JsonValue> t1 = a1.feed([&] { return s1.read(); });
+    auto outer = [&] () -> ParseTask<JsonValue> { co_return co_await a2.feed([&] { return s2.read(); }); };
+    ParseTask<JsonValue> t2 = outer();
+    t1.start();
+    t2.start();
+    for (size_t i = 0; i < 3; i++) {
+        assert(!t1.done() && s1.waiting && s2.waiting);
+        s1.deliver();
+        s2.deliver();
+    }
+    assert(!t1.done() && t2.done() && s2.next == 3 && t2.result().result == parse(jsonP(), "[true]").result);
+    s1.deliver();
+    assert(t1.done() && !s1.waiting && t1.result().result == parse(jsonP(), "{\"a\": [1, 2]}").result);
+    Socket s3({"[1", ""});
+    AsyncParser<JsonValue> a3(jsonP());
+    ParseTask<JsonValue> t3 = a3.feed([&] { return s3.read(); });
+    t3.start();
+    s3.deliver();
+    s3.deliver();
+    assert(t3.done() && t3.result().error == parse(jsonP(), "[1").error);
+#endif
+#ifdef CPARSEC_PROFILE
+    Parser<std::string_view> word = namedP("word", orP(namedP("abc", literalP("abc")), namedP("abd", literalP("abd"))));
+    Profile prof;
+    ParseContext pc;
+    pc.profile = &prof;
+    assert(parse(manyP(word), "abdabcabx", pc).state.pos == 6);
+    std::vector<Profile::Stats> ps = prof.stats();
+    auto statsOf = [&] (std::string name) { return *std::find_if(ps.begin(), ps.end(), [&] (const Profile::Stats &x) { return x.name == name; }); };
+    Profile::Stats sword = statsOf("word"), sc = statsOf("abc"), sd = statsOf("abd");
+    assert(ps.size() == 3 && ps[0].name == "word" && sword.calls == 3 && sword.successes == 2 && sword.failures == 1 && sword.consumed == 6 && sword.backtracked == 2);
+    assert(sc.calls == 3 && sc.successes == 1 && sc.backtracked == 4 && sd.calls == 2 && sd.failures == 1 && sd.backtracked == 2);
+    std::ostringstream flame, tab;
+    prof.folded(flame);
+    prof.table(tab);
+    assert(flame.str().find("word;abc ") != std::string::npos && tab.str().find("backtracked") != std::string::npos);
+    prof.clear();
+    assert(parse(jsonP(), "[1, {\"a\": []}]", pc).success && prof.stats()[0].name == "value");
+    assert(prof.stats()[0].calls == 5 && prof.stats()[0].failures == 1 && prof.stats()[1].name == "array" && prof.stats()[1].consumed == 16);
+#endif
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+
+// the operators of an expression language, by symbol. the table may change
+// at any time, from any thread, while parsers built on it are running: a
+// parse works with the operators as they were when it started. a symbol
+// can be both a prefix and an infix operator, as '-' usually is; higher
+// precedence binds tighter.
+template<typename T>
+struct OperatorTable {
+    enum Assoc { LEFT, RIGHT };
+    struct Infix {
+        std::string symbol;
+        int prec;
+        Assoc assoc;
+        std::function<T(T, T)> f;
+    };
+    struct Prefix {
+        std::string symbol;
+        int prec;
+        std::function<T(T)> f;
+    };
+    // one version of the table; infixP and prefixP yield an index into it
+    struct Ops {
+        std::vector<Infix> infix;
+        std::vector<Prefix> prefix;
+        Parser<size_t> infixP = keywordsP({}), prefixP = keywordsP({});
+    };
+    OperatorTable(): ops(std::make_shared<const Ops>()) {}
+    OperatorTable(const OperatorTable &) = delete;
+    OperatorTable &operator=(const OperatorTable &) = delete;
+    // adds an operator, or replaces the one of the same kind and symbol
+    void infix(std::string symbol, int prec, Assoc assoc, std::function<T(T, T)> f) {
+        update([&] (Ops &o) {
+            erase(o.infix, symbol);
+            o.infix.push_back(Infix{std::move(symbol), prec, assoc, std::move(f)});
+        });
+    }
+    void prefix(std::string symbol, int prec, std::function<T(T)> f) {
+        update([&] (Ops &o) {
+            erase(o.prefix, symbol);
+            o.prefix.push_back(Prefix{std::move(symbol), prec, std::move(f)});
+        });
+    }
+    // drops both kinds of operator spelled symbol
+    void remove(std::string_view symbol) {
+        update([&] (Ops &o) {
+            erase(o.infix, symbol);
+            erase(o.prefix, symbol);
+        });
+    }
+    std::shared_ptr<const Ops> snapshot() const {
+        std::lock_guard<std::mutex> l(m);
+        return ops;
+    }
+private:
+    template<typename V>
+    static void erase(V &v, std::string_view symbol) {
+        v.erase(std::remove_if(v.begin(), v.end(), [&] (const auto &o) { return o.symbol == symbol; }), v.end());
+    }
+    // symbols are matched longest first, as plain literals
+    template<typename V>
+    static Parser<size_t> symbolsP(const V &v) {
+        std::vector<std::string> words;
+        for (const auto &o : v) words.push_back(o.symbol);
+        return keywordsP(words);
+    }
+    template<typename F>
+    void update(F f) {
+        std::lock_guard<std::mutex> l(m);
+        std::shared_ptr<Ops> next = std::make_shared<Ops>(*ops);
+        f(*next);
+        next->infixP = symbolsP(next->infix);
+        next->prefixP = symbolsP(next->prefix);
+        ops = next;
+    }
+    mutable std::mutex m;
+    std::shared_ptr<const Ops> ops;
+};
+
+// an expression of operands joined by the operators of the table, parsed
+// in one loop with an explicit stack of pending operators, so neither long
+// chains nor many precedence levels cost any recursion. whitespace around
+// operators is skipped; the operand takes care of its own. an infix
+// operator that is not followed by an operand is left unconsumed. the
+// table must outlive the parser.
+template<typename T>
+Parser<T> prattP(Parser<T> operand, const OperatorTable<T> &table) {
+    using Table = OperatorTable<T>;
+    const Table *t = &table;
+    return [=] (ParseState s) {
+        std::shared_ptr<const typename Table::Ops> ops = t->snapshot();
+        bool keep = !s.skipping() || !std::is_default_constructible_v<T>;
+        struct Pending {
+            bool prefix;
+            size_t i;
+            int prec;
+        };
+        std::vector<T> values;
+        std::vector<Pending> pending;
+        auto reduce = [&] {
+            Pending o = pending.back();
+            pending.pop_back();
+            if (!keep) return;
+            if (o.prefix) {
+                values.back() = ops->prefix[o.i].f(std::move(values.back()));
+                return;
+            }
+            T y = std::move(values.back());
+            values.pop_back();
+            values.back() = ops->infix[o.i].f(std::move(values.back()), std::move(y));
+        };
+        // prefix operators and the operand they apply to
+        auto unit = [&] (ParseState u) {
+            while (true) {
+                ParseResult<size_t> o = ops->prefixP(u);
+                if (!o.success) break;
+                pending.push_back(Pending{true, o.result, ops->prefix[o.result].prec});
+                u = skipSpace(o.state);
+            }
+            ParseResult<T> x = operand(u);
+            if (!x.success) return ParseResult<bool>(x.state, x.error);
+            if (keep) values.push_back(std::move(x.result));
+            return success(x.state, true);
+        };
+        ParseResult<bool> x = unit(s);
+        if (!x.success) return ParseResult<T>(x.state, x.error);
+        ParseState at = x.state;
+        while (true) {
+            ChoicePoint c(at);
+            ParseResult<size_t> o = ops->infixP(skipSpace(at));
+            if (!o.success) break;
+            const typename Table::Infix &op = ops->infix[o.result];
+            while (!pending.empty() && (pending.back().prec > op.prec ||
+                   (pending.back().prec == op.prec && (op.assoc == Table::LEFT || pending.back().prefix))))
+                reduce();
+            size_t mark = pending.size();
+            pending.push_back(Pending{false, o.result, op.prec});
+            x = unit(skipSpace(o.state));
+            if (!x.success) {
+                if (x.error.fatal()) return ParseResult<T>(x.state, x.error);
+                pending.resize(mark);
+                break;
+            }
+            at = x.state;
+        }
+        while (!pending.empty()) reduce();
+        if constexpr (std::is_default_constructible_v<T>)
+            if (!keep) return success(at, T());
+        return success(at, std::move(values.back()));
+    };
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include <string>
+#include <string_view>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// a read-only mapping of a whole file, read ahead sequentially. error is
+// the errno of a failed open or map, in which case the view is empty.
+struct MappedFile {
+    explicit MappedFile(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = errno;
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) error = errno;
+        else if (st.st_size > 0) {
+            void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m == MAP_FAILED) error = errno;
+            else {
+                madvise(m, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const char *>(m);
+                size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() {
+        if (data) munmap(const_cast<char *>(data), size);
+    }
+    std::string_view view() const {
+        return std::string_view(data, size);
+    }
+    const char *data = nullptr;
+    size_t size = 0;
+    int error = 0;
+};
+
+// what a file parse keeps alive for its result: the mapping, which string
+// views in the result point into, and the arena the result was built in
+struct FileHold {
+    std::shared_ptr<const MappedFile> file;
+    std::shared_ptr<std::pmr::monotonic_buffer_resource> arena;
+};
+
+// FileHold is the first base so that it outlives the result it holds up
+template<typename T>
+struct FileParseResult : FileHold, ParseResult<T> {
+    FileParseResult(FileHold h, ParseResult<T> r): FileHold(std::move(h)), ParseResult<T>(std::move(r)) {}
+};
+
+// runs p over the mapped file in place, with no copy of the input. results
+// are allocated in an arena owned by the returned value, so jsonStrViewP()
+// and the like can hand out views into the file. a file that cannot be
+// mapped fails with ERR_IO at offset 0.
+template<typename T>
+FileParseResult<T> parseFile(const Parser<T> &p, const std::string &path) {
+    FileHold h;
+    std::shared_ptr<MappedFile> f = std::make_shared<MappedFile>(path);
+    h.file = f;
+    if (f->error) return FileParseResult<T>(h, ParseResult<T>(ParseState(f->view()), ParseError{0, ERR_IO, 0}));
+    h.arena = std::make_shared<std::pmr::monotonic_buffer_resource>();
+    ParseContext ctx;
+    ctx.memory = h.arena.get();
+    ParseResult<T> r = p(ParseState(f->view(), &ctx));
+    r.state.ctx = nullptr;
+    return FileParseResult<T>(h, std::move(r));
+}
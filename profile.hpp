@@ -0,0 +1,164 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <cstdio>
+
+// what the namedP rules of a grammar did over the parses a Profile was in
+// the context of, accumulated until clear(). per rule:
+//  calls, successes and failures;
+//  consumed, the bytes its successes advanced over;
+//  backtracked, the bytes its failures had got through while a choice was
+//   pending, which the alternative tried next reads again;
+//  nanos, inclusive time, counted once for a recursive rule.
+// the time of each rule less that of the rules under it is also kept per
+// stack of names, for folded() to write as a flame graph. a profile is used
+// by one parse at a time.
+//     Profile prof;
+//     ParseContext ctx;
+//     ctx.profile = &prof;
+//     parse(p, s, ctx);
+//     prof.table(std::cout);
+struct Profile {
+    struct Stats {
+        std::string name;
+        unsigned long long calls = 0, successes = 0, failures = 0;
+        unsigned long long consumed = 0, backtracked = 0, nanos = 0;
+    };
+    Profile() {
+        clear();
+    }
+    Profile(const Profile &) = delete;
+    Profile &operator=(const Profile &) = delete;
+    void clear() {
+        rules.clear();
+        nodes.assign(1, Node{0, 0, 0});
+        children.clear();
+        frames.clear();
+    }
+    // the stats of every rule that ran, by name, most time first
+    std::vector<Stats> stats() const {
+        std::vector<Stats> v;
+        for (const Rule &r : rules)
+            if (r.stats.calls) v.push_back(r.stats);
+        std::stable_sort(v.begin(), v.end(), [] (const Stats &a, const Stats &b) { return a.nanos > b.nanos; });
+        return v;
+    }
+    void table(std::ostream &os) const {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-24s %12s %12s %12s %14s %14s %12s\n",
+                      "rule", "calls", "successes", "failures", "consumed", "backtracked", "ms");
+        os << line;
+        for (const Stats &s : stats()) {
+            std::snprintf(line, sizeof(line), "%-24s %12llu %12llu %12llu %14llu %14llu %12.3f\n", s.name.c_str(),
+                          s.calls, s.successes, s.failures, s.consumed, s.backtracked, s.nanos / 1e6);
+            os << line;
+        }
+    }
+    // one "outer;inner;rule nanos" line per stack with time of its own, the
+    // input of flamegraph.pl and of most flame graph viewers
+    void folded(std::ostream &os) const {
+        for (size_t i = 1; i < nodes.size(); i++) {
+            if (!nodes[i].self) continue;
+            std::vector<size_t> path;
+            for (size_t n = i; n; n = nodes[n].parent) path.push_back(nodes[n].rule);
+            for (size_t k = path.size(); k--; ) {
+                for (char c : rules[path[k]].stats.name) os << (c == ';' || c == ' ' ? '_' : c);
+                os << (k ? ';' : ' ');
+            }
+            os << nodes[i].self << '\n';
+        }
+    }
+
+    // the bookkeeping of namedP around each run of a rule
+    void enter(size_t rule, const std::string &name) {
+        if (rule >= rules.size()) rules.resize(rule + 1);
+        Rule &r = rules[rule];
+        if (r.stats.name.empty()) r.stats.name = name;
+        r.stats.calls++;
+        r.active++;
+        size_t parent = frames.empty() ? 0 : frames.back().node;
+        auto it = children.find(std::make_pair(parent, rule));
+        if (it == children.end()) {
+            it = children.emplace(std::make_pair(parent, rule), nodes.size()).first;
+            nodes.push_back(Node{parent, rule, 0});
+        }
+        frames.push_back(Frame{rule, it->second, 0, now()});
+    }
+    // backtracked is 0 unless the failure returns to a pending choice
+    void leave(bool success, unsigned long long consumed, unsigned long long backtracked) {
+        Frame f = frames.back();
+        frames.pop_back();
+        unsigned long long t = now() - f.start;
+        Rule &r = rules[f.rule];
+        if (success) {
+            r.stats.successes++;
+            r.stats.consumed += consumed;
+        } else {
+            r.stats.failures++;
+            r.stats.backtracked += backtracked;
+        }
+        if (!--r.active) r.stats.nanos += t;
+        nodes[f.node].self += t > f.children ? t - f.children : 0;
+        if (!frames.empty()) frames.back().children += t;
+    }
+private:
+    static unsigned long long now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    struct Rule {
+        Stats stats;
+        unsigned active = 0;
+    };
+    // one stack of rules seen, under the node of its caller; 0 is the root
+    struct Node {
+        size_t parent, rule;
+        unsigned long long self;
+    };
+    struct Frame {
+        size_t rule, node;
+        unsigned long long children, start;
+    };
+    std::vector<Rule> rules;
+    std::vector<Node> nodes;
+    std::map<std::pair<size_t, size_t>, size_t> children;
+    std::vector<Frame> frames;
+};
+
+size_t nextNamedRule() {
+    static std::atomic<size_t> n{0};
+    return n++;
+}
+
+// p, reported as name by the Profile of the parse. without CPARSEC_PROFILE
+// defined this is p itself and costs nothing; with it, a parse that has no
+// profile pays one test per rule.
+#ifdef CPARSEC_PROFILE
+template<typename T>
+Parser<T> namedP(std::string name, Parser<T> p) {
+    size_t rule = nextNamedRule();
+    Parser<T> q = [=] (ParseState s) {
+        Profile *prof = s.ctx ? s.ctx->profile : nullptr;
+        if (!prof) return p(s);
+        prof->enter(rule, name);
+        ParseResult<T> r = p(s);
+        if (r.success) prof->leave(true, r.state.pos - s.pos, 0);
+        else prof->leave(false, 0, s.ctx->choices && !r.error.fatal() && r.error.pos > s.pos ? r.error.pos - s.pos : 0);
+        return r;
+    };
+    q.first = p.first;
+    return q;
+}
+#else
+template<typename T>
+Parser<T> namedP(std::string, Parser<T> p) {
+    return p;
+}
+#endif
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// a fixed set of threads that runs batches of tasks. each worker starts on
+// its own contiguous share of a batch and, once that is exhausted, steals
+// single tasks from the back of the others' shares. the calling thread takes
+// part as worker 0, so a pool of size() 1 runs everything inline.
+struct WorkPool {
+    explicit WorkPool(unsigned threads = std::thread::hardware_concurrency()) {
+        if (threads == 0) threads = 1;
+        queues = std::vector<Queue>(threads);
+        for (unsigned w = 1; w < threads; w++) workers.emplace_back([this, w] { loop(w); });
+    }
+    WorkPool(const WorkPool &) = delete;
+    WorkPool &operator=(const WorkPool &) = delete;
+    ~WorkPool() {
+        {
+            std::lock_guard<std::mutex> l(m);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : workers) t.join();
+    }
+    size_t size() const {
+        return queues.size();
+    }
+    // runs f(worker, task) for every task below n and returns once all are
+    // done; worker is below size(). batches from several threads take turns.
+    // a task that runs a batch on its own pool, such as parallelArrayP as
+    // the record parser of parseRecords, gets it run inline as worker 0:
+    // every worker is already busy with the outer batch.
+    void run(size_t n, const std::function<void(size_t, size_t)> &f) {
+        if (inside() == this) {
+            for (size_t t = 0; t < n; t++) f(0, t);
+            return;
+        }
+        std::lock_guard<std::mutex> turn(running);
+        size_t k = queues.size();
+        for (size_t w = 0; w < k; w++) {
+            std::lock_guard<std::mutex> l(queues[w].m);
+            queues[w].begin = n * w / k;
+            queues[w].end = n * (w + 1) / k;
+        }
+        {
+            std::lock_guard<std::mutex> l(m);
+            job = &f;
+            active = k - 1;
+            generation++;
+        }
+        wake.notify_all();
+        work(0, f);
+        std::unique_lock<std::mutex> l(m);
+        done.wait(l, [this] { return active == 0; });
+        job = nullptr;
+    }
+private:
+    struct Queue {
+        std::mutex m;
+        size_t begin = 0, end = 0;
+    };
+    void loop(size_t w) {
+        size_t seen = 0;
+        while (true) {
+            const std::function<void(size_t, size_t)> *f;
+            {
+                std::unique_lock<std::mutex> l(m);
+                wake.wait(l, [&] { return stop || generation != seen; });
+                if (stop) return;
+                seen = generation;
+                f = job;
+            }
+            work(w, *f);
+            std::lock_guard<std::mutex> l(m);
+            if (--active == 0) done.notify_one();
+        }
+    }
+    // the pool whose batch the calling thread is working on, if any
+    static const WorkPool *&inside() {
+        static thread_local const WorkPool *pool = nullptr;
+        return pool;
+    }
+    void work(size_t w, const std::function<void(size_t, size_t)> &f) {
+        inside() = this;
+        size_t t;
+        while (take(w, t) || steal(w, t)) f(w, t);
+        inside() = nullptr;
+    }
+    bool take(size_t w, size_t &t) {
+        std::lock_guard<std::mutex> l(queues[w].m);
+        if (queues[w].begin == queues[w].end) return false;
+        t = queues[w].begin++;
+        return true;
+    }
+    bool steal(size_t w, size_t &t) {
+        for (size_t i = 1; i < queues.size(); i++) {
+            Queue &q = queues[(w + i) % queues.size()];
+            std::lock_guard<std::mutex> l(q.m);
+            if (q.begin == q.end) continue;
+            t = --q.end;
+            return true;
+        }
+        return false;
+    }
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::mutex running, m;
+    std::condition_variable wake, done;
+    const std::function<void(size_t, size_t)> *job = nullptr;
+    size_t generation = 0, active = 0;
+    bool stop = false;
+};
+
+WorkPool &defaultPool() {
+    static WorkPool pool;
+    return pool;
+}
+
+// the pieces a record buffer is cut into for the pool: about eight per
+// worker, none smaller than minChunk, each ending just after a delimiter
+std::vector<std::string_view> recordChunks(std::string_view s, size_t workers, char delim, size_t minChunk = 1 << 16) {
+    std::vector<std::string_view> chunks;
+    size_t step = std::max(minChunk, s.size() / (workers * 8 + 1));
+    size_t b = 0;
+    while (b < s.size()) {
+        size_t e = b + step >= s.size() ? s.size() : s.find(delim, b + step);
+        e = e == std::string_view::npos ? s.size() : std::min(e + 1, s.size());
+        chunks.push_back(s.substr(b, e - b));
+        b = e;
+    }
+    return chunks;
+}
+
+// parses each non-blank record of one chunk, which starts at offset base of
+// the whole buffer s, and hands it to f with its offset. a record must be
+// consumed entirely by p, or it fails with ERR_EXPECT_EOF.
+template<typename T, typename F>
+void parseChunk(const Parser<T> &p, std::string_view s, std::string_view chunk, char delim, ParseContext &ctx, F &&f) {
+    static const ClassScanner blank(spaceClass | CharClass("\r"));
+    size_t base = chunk.data() - s.data(), b = 0;
+    while (b < chunk.size()) {
+        size_t e = std::min(chunk.find(delim, b), chunk.size());
+        if (blank.span(chunk.data() + b, e - b) < e - b) {
+            std::string_view upto = s.substr(0, base + e);
+            ParseResult<T> r = p(ParseState(base + b, upto, &ctx));
+            if (r.success && r.state.pos != upto.size()) {
+                ParseState at = skipSpace(r.state);
+                if (at.pos < upto.size() && at.s[at.pos] == '\r') at.pos++;
+                if (at.pos != upto.size()) r = failure<T>(at, ERR_EXPECT_EOF);
+            }
+            r.state.ctx = nullptr;
+            f(base + b, r);
+        }
+        b = e + 1;
+    }
+}
+
+// the results of parseRecords, in input order. each worker built its
+// results in an arena of its own, released together with them.
+template<typename T>
+struct Records {
+    std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> arenas;
+    std::vector<ParseResult<T>> results;
+};
+
+// parses every delimited record of s (one JSON document per line, by
+// default) on the pool. error offsets are offsets into s.
+template<typename T>
+Records<T> parseRecords(const Parser<T> &p, std::string_view s, WorkPool &pool = defaultPool(), char delim = '\n') {
+    std::vector<std::string_view> chunks = recordChunks(s, pool.size(), delim);
+    Records<T> out;
+    for (size_t w = 0; w < pool.size(); w++)
+        out.arenas.push_back(std::make_unique<std::pmr::monotonic_buffer_resource>());
+    std::vector<std::vector<ParseResult<T>>> parts(chunks.size());
+    auto task = [&] (size_t w, size_t c) {
+        ParseContext ctx;
+        ctx.memory = out.arenas[w].get();
+        parseChunk(p, s, chunks[c], delim, ctx, [&] (unsigned long long, ParseResult<T> &r) {
+            parts[c].push_back(std::move(r));
+        });
+    };
+    if (chunks.size() == 1) task(0, 0);
+    else if (chunks.size() > 1) pool.run(chunks.size(), task);
+    size_t n = 0;
+    for (const auto &part : parts) n += part.size();
+    out.results.reserve(n);
+    for (auto &part : parts)
+        for (ParseResult<T> &r : part) out.results.push_back(std::move(r));
+    return out;
+}
+
+// the streaming form: f(offset, result) is called for every record, from
+// several threads at once and in no particular order, with a result that
+// only lives for the duration of the call
+template<typename T, typename F>
+void forEachRecord(const Parser<T> &p, std::string_view s, F f, WorkPool &pool = defaultPool(), char delim = '\n') {
+    std::vector<std::string_view> chunks = recordChunks(s, pool.size(), delim);
+    std::vector<std::pmr::monotonic_buffer_resource> arenas(pool.size());
+    auto task = [&] (size_t w, size_t c) {
+        ParseContext ctx;
+        ctx.memory = &arenas[w];
+        parseChunk(p, s, chunks[c], delim, ctx, [&] (unsigned long long offset, ParseResult<T> &r) {
+            f(offset, r);
+        });
+        arenas[w].release();
+    };
+    if (chunks.size() == 1) task(0, 0);
+    else if (chunks.size() > 1) pool.run(chunks.size(), task);
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include "cparsec.hpp"
+#include <string>
+#include <string_view>
+#include <list>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+// statically typed combinators: every parser is its own concrete type, so a
+// grammar built from them is inlined into straight-line code. any callable
+// ParseState -> ParseResult<T> is a parser here, including Parser<T> itself,
+// and every parser here converts to Parser<T>.
+namespace sp {
+
+template<typename P>
+using result_t = decltype(std::declval<const P &>()(std::declval<ParseState>()));
+
+template<typename P>
+using value_t = typename result_t<P>::value_type;
+
+template<typename P>
+Parser<value_t<P>> erase(P p) {
+    return p;
+}
+
+struct IdP {
+    using value_type = char;
+    ParseResult<char> operator()(ParseState s) const {
+        if (atEnd(s)) return failure<char>(s, ERR_EOF);
+        return success(s.advance(1), s.s[s.pos]);
+    }
+};
+
+struct EofP {
+    using value_type = bool;
+    ParseResult<bool> operator()(ParseState s) const {
+        if (atEnd(s)) return success(s, true);
+        return failure<bool>(s, ERR_EXPECT_EOF);
+    }
+};
+
+const IdP idP;
+const EofP eofP;
+
+template<typename F>
+struct PredP {
+    using value_type = char;
+    F f;
+    ParseResult<char> operator()(ParseState s) const {
+        if (atEnd(s)) return failure<char>(s, ERR_EOF);
+        char c = s.s[s.pos];
+        if (!f(c)) return failure<char>(s, ERR_UNEXPECT, c);
+        return success(s.advance(1), c);
+    }
+};
+
+template<typename F>
+PredP<F> predP(F f) {
+    return PredP<F>{f};
+}
+
+struct CharP {
+    using value_type = char;
+    char c;
+    ParseResult<char> operator()(ParseState s) const {
+        if (atEnd(s) || s.s[s.pos] != c) return failure<char>(s, ERR_EXPECT_CHAR, c);
+        return success(s.advance(1), c);
+    }
+};
+
+CharP charP(char c) {
+    return CharP{c};
+}
+
+struct OneOfP {
+    using value_type = char;
+    CharClass cs;
+    ParseResult<char> operator()(ParseState s) const {
+        if (atEnd(s)) return failure<char>(s, ERR_EOF);
+        char c = s.s[s.pos];
+        if (!cs[c]) return failure<char>(s, ERR_UNEXPECT, c);
+        return success(s.advance(1), c);
+    }
+};
+
+OneOfP oneOfP(CharClass cs) {
+    return OneOfP{cs};
+}
+
+struct StringP {
+    using value_type = std::string;
+    std::string str;
+    ParseResult<std::string> operator()(ParseState s) const {
+        ParseResult<std::string_view> r = literalAt(s, str);
+        if (!r.success) return ParseResult<std::string>(r.state, r.error);
+        return success(r.state, str);
+    }
+};
+
+StringP stringP(std::string str) {
+    return StringP{str};
+}
+
+struct LiteralP {
+    using value_type = std::string_view;
+    std::string lit;
+    ParseResult<std::string_view> operator()(ParseState s) const {
+        return literalAt(s, lit);
+    }
+};
+
+LiteralP literalP(std::string lit) {
+    return LiteralP{lit};
+}
+
+template<typename T>
+struct PureP {
+    using value_type = T;
+    T x;
+    ParseResult<T> operator()(ParseState s) const {
+        return success(s, x);
+    }
+};
+
+template<typename T>
+PureP<T> pureP(T x) {
+    return PureP<T>{x};
+}
+
+template<typename P, typename F>
+struct MapP {
+    using value_type = std::decay_t<std::invoke_result_t<const F &, value_t<P>>>;
+    P p;
+    F f;
+    ParseResult<value_type> operator()(ParseState s) const {
+        result_t<P> r = p(s);
+        if (!r.success) return ParseResult<value_type>(r.state, r.error);
+        return success(r.state, f(std::move(r.result)));
+    }
+};
+
+template<typename P, typename F>
+MapP<P, F> mapP(P p, F f) {
+    return MapP<P, F>{p, f};
+}
+
+template<typename PA, typename PB, typename F>
+struct AndP {
+    using value_type = std::decay_t<std::invoke_result_t<const F &, value_t<PA>, value_t<PB>>>;
+    PA pa;
+    PB pb;
+    F f;
+    ParseResult<value_type> operator()(ParseState s) const {
+        result_t<PA> ra = pa(s);
+        if (!ra.success) return ParseResult<value_type>(ra.state, ra.error);
+        result_t<PB> rb = pb(ra.state);
+        if (!rb.success) return ParseResult<value_type>(rb.state, rb.error);
+        return success(rb.state, f(std::move(ra.result), std::move(rb.result)));
+    }
+};
+
+template<typename PA, typename PB, typename F>
+AndP<PA, PB, F> andP(PA pa, PB pb, F f) {
+    return AndP<PA, PB, F>{pa, pb, f};
+}
+
+struct TakeLeft {
+    template<typename A, typename B>
+    A operator()(A a, B) const { return std::move(a); }
+};
+
+struct TakeRight {
+    template<typename A, typename B>
+    B operator()(A, B b) const { return std::move(b); }
+};
+
+template<typename PA, typename PB>
+AndP<PA, PB, TakeLeft> leftP(PA pa, PB pb) {
+    return AndP<PA, PB, TakeLeft>{pa, pb, TakeLeft{}};
+}
+
+template<typename PA, typename PB>
+AndP<PA, PB, TakeRight> rightP(PA pa, PB pb) {
+    return AndP<PA, PB, TakeRight>{pa, pb, TakeRight{}};
+}
+
+template<typename P, typename... Ps>
+struct OrP {
+    using value_type = value_t<P>;
+    static_assert((std::is_same_v<value_type, value_t<Ps>> && ...), "orP alternatives must have the same type");
+    std::tuple<P, Ps...> ps;
+    template<size_t I>
+    ParseResult<value_type> alt(ParseState s) const {
+        ParseResult<value_type> r = [&] {
+            ChoicePoint c(s, I < sizeof...(Ps));
+            return std::get<I>(ps)(s);
+        }();
+        if constexpr (I < sizeof...(Ps)) {
+            if (r.success || r.error.fatal()) return r;
+            ParseResult<value_type> rq = alt<I + 1>(s);
+            if (rq.success || rq.error.fatal() || rq.error.pos >= r.error.pos) return rq;
+        }
+        return r;
+    }
+    ParseResult<value_type> operator()(ParseState s) const {
+        return alt<0>(s);
+    }
+};
+
+template<typename P, typename... Ps>
+OrP<P, Ps...> orP(P p, Ps... ps) {
+    return OrP<P, Ps...>{std::make_tuple(p, ps...)};
+}
+
+template<typename P>
+struct ManyP {
+    using value_type = std::list<value_t<P>>;
+    P p;
+    ParseResult<value_type> operator()(ParseState s) const {
+        value_type xs;
+        while (true) {
+            ChoicePoint c(s);
+            result_t<P> r = p(s);
+            if (!r.success && r.error.fatal()) return ParseResult<value_type>(r.state, r.error);
+            if (!r.success || r.state.pos == s.pos) break;
+            xs.push_back(std::move(r.result));
+            s = r.state;
+        }
+        return success(s, std::move(xs));
+    }
+};
+
+template<typename P>
+ManyP<P> manyP(P p) {
+    return ManyP<P>{p};
+}
+
+template<typename P>
+struct SomeP {
+    using value_type = std::list<value_t<P>>;
+    P p;
+    ParseResult<value_type> operator()(ParseState s) const {
+        result_t<P> r = p(s);
+        if (!r.success) return ParseResult<value_type>(r.state, r.error);
+        ParseResult<value_type> rs = ManyP<P>{p}(r.state);
+        if (!rs.success) return rs;
+        rs.result.push_front(std::move(r.result));
+        return rs;
+    }
+};
+
+template<typename P>
+SomeP<P> someP(P p) {
+    return SomeP<P>{p};
+}
+
+template<typename PL, typename PR, typename P>
+auto betweenP(PL lp, PR rp, P p) {
+    return rightP(lp, leftP(p, rp));
+}
+
+// skips whitespace without building the list trimP would discard anyway
+struct SpacesP {
+    using value_type = bool;
+    ParseResult<bool> operator()(ParseState s) const {
+        return success(skipSpace(s), true);
+    }
+};
+
+const SpacesP spaces;
+
+template<typename P>
+auto trimP(P p) {
+    return rightP(spaces, leftP(p, spaces));
+}
+
+// the one place a grammar pays for type erasure: a reference to a Parser<T>
+// that may be assigned after this is built, which is how recursion is tied
+template<typename T>
+struct LazyP {
+    using value_type = T;
+    const Parser<T> *p;
+    ParseResult<T> operator()(ParseState s) const {
+        return (*p)(s);
+    }
+};
+
+template<typename T>
+LazyP<T> lazyP(const Parser<T> &p) {
+    return LazyP<T>{&p};
+}
+
+}